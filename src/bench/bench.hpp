@@ -0,0 +1,51 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+namespace spi {
+	namespace bench {
+		//! nThread個のスレッドで同時にf(スレッド番号)を実行し、全員が終わるまでの秒数を返す
+		template <class F>
+		double Measure(const std::size_t nThread, const F& f) {
+			std::atomic<std::size_t> ready(0);
+			std::atomic<bool> start(false);
+			std::vector<std::thread> th;
+			th.reserve(nThread);
+			for(std::size_t i=0 ; i<nThread ; i++) {
+				th.emplace_back([&, i](){
+					++ready;
+					while(!start.load(std::memory_order_acquire))
+						std::this_thread::yield();
+					f(i);
+				});
+			}
+			while(ready.load() != nThread)
+				std::this_thread::yield();
+			const auto t0 = std::chrono::steady_clock::now();
+			start.store(true, std::memory_order_release);
+			for(auto& t : th)
+				t.join();
+			const auto t1 = std::chrono::steady_clock::now();
+			return std::chrono::duration<double>(t1 - t0).count();
+		}
+		//! 1, 2, 4, ... とmaxThread(0ならハードウェアのスレッド数)まで倍々に増やしたスレッド数
+		inline std::vector<std::size_t> ThreadCounts(std::size_t maxThread = 0) {
+			if(maxThread == 0)
+				maxThread = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+			std::vector<std::size_t> ret;
+			for(std::size_t n=1 ; n<maxThread ; n*=2)
+				ret.push_back(n);
+			ret.push_back(maxThread);
+			return ret;
+		}
+		//! コマンドライン引数(無ければdef)
+		inline std::size_t Arg(const int argc, char** argv, const int idx, const std::size_t def) {
+			return argc > idx ? std::strtoull(argv[idx], nullptr, 10) : def;
+		}
+	}
+}
@@ -0,0 +1,112 @@
+//! noseq_vec::erase_indices, erase_ifと、1要素ずつのeraseの比較
+/*!
+	要素数Nの配列から1/4の要素を削除する時間(ms, 反復の平均)
+	削除対象はランダムに散らばった物と、64要素毎の塊になった物の2通り
+	usage: bench_noseq_vec_erase [要素数] [反復回数]
+*/
+#include "../noseq_vec.hpp"
+#include "bench.hpp"
+#include <string>
+#include <cstdint>
+
+namespace {
+	uint64_t Next(uint64_t& s) noexcept {
+		s ^= s << 13;
+		s ^= s >> 7;
+		s ^= s << 17;
+		return s;
+	}
+	using Index = std::vector<std::size_t>;
+	//! 1/4をランダムに選んだインデックス(昇順)
+	Index Scattered(const std::size_t n) {
+		uint64_t s = 1;
+		Index ret;
+		for(std::size_t i=0 ; i<n ; i++) {
+			if((Next(s) & 3) == 0)
+				ret.push_back(i);
+		}
+		return ret;
+	}
+	//! 64要素の塊を1/4の確率で選んだインデックス(昇順)
+	Index Clustered(const std::size_t n) {
+		uint64_t s = 1;
+		Index ret;
+		for(std::size_t i=0 ; i<n ; i+=64) {
+			if((Next(s) & 3) == 0) {
+				for(std::size_t j=i ; j<std::min(i+64, n) ; j++)
+					ret.push_back(j);
+			}
+		}
+		return ret;
+	}
+	//! 削除対象かのフラグ(erase_if用)
+	template <class T>
+	bool IsTarget(const T& v, const std::vector<bool>& flag) {
+		if constexpr (std::is_same_v<T, std::string>)
+			return flag[std::stoul(v)];
+		else
+			return flag[v];
+	}
+	//! src をコピーしてからf(コピー)に掛かった時間の平均(ms)
+	template <class V, class F>
+	double Time(const V& src, const std::size_t nIter, const F& f) {
+		double sum = 0;
+		std::size_t check = 0;
+		for(std::size_t i=0 ; i<nIter ; i++) {
+			V v(src);
+			const auto t0 = std::chrono::steady_clock::now();
+			f(v);
+			const auto t1 = std::chrono::steady_clock::now();
+			sum += std::chrono::duration<double, std::milli>(t1 - t0).count();
+			check += v.size();
+		}
+		// 最適化で削除処理が消されないように結果を使う
+		if(check == std::size_t(-1))
+			std::printf("\n");
+		return sum / double(nIter);
+	}
+	template <class T, class Make>
+	void Run(const char* name, const std::size_t n, const std::size_t nIter, const Make& make) {
+		spi::noseq_vec<T> src;
+		src.reserve(n);
+		for(std::size_t i=0 ; i<n ; i++)
+			src.push_back(make(i));
+		for(int pattern=0 ; pattern<2 ; pattern++) {
+			const Index idx = pattern == 0 ? Scattered(n) : Clustered(n);
+			std::vector<bool> flag(n, false);
+			for(auto i : idx)
+				flag[i] = true;
+			const double
+				// 後ろから1要素ずつ(末尾と交換して削除)
+				t0 = Time(src, nIter, [&idx](auto& v){
+					for(auto itr=idx.rbegin() ; itr!=idx.rend() ; ++itr)
+						v.erase(v.begin() + *itr);
+				}),
+				t1 = Time(src, nIter, [&idx](auto& v){
+					v.erase_indices(idx);
+				}),
+				// 先頭から条件を判定して1要素ずつ削除
+				t2 = Time(src, nIter, [&flag](auto& v){
+					for(std::size_t i=0 ; i<v.size() ; ) {
+						if(IsTarget(v[i], flag))
+							v.erase(v.begin() + i);
+						else
+							++i;
+					}
+				}),
+				t3 = Time(src, nIter, [&flag](auto& v){
+					v.erase_if([&flag](const auto& e){ return IsTarget(e, flag); });
+				});
+			std::printf("%s\t%s\t%.3f\t%.3f\t%.3f\t%.3f\n",
+				name, pattern == 0 ? "scattered" : "clustered", t0, t1, t2, t3);
+		}
+	}
+}
+int main(const int argc, char** argv) {
+	const std::size_t n = spi::bench::Arg(argc, argv, 1, 1 << 20),
+					nIter = std::max<std::size_t>(spi::bench::Arg(argc, argv, 2, 10), 1);
+	std::printf("type\tpattern\terase[ms]\terase_indices[ms]\terase(pred)[ms]\terase_if[ms]\n");
+	Run<uint32_t>("uint32_t", n, nIter, [](const std::size_t i){ return uint32_t(i); });
+	Run<std::string>("string", n, nIter, [](const std::size_t i){ return std::to_string(i); });
+	return 0;
+}
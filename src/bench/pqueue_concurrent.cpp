@@ -0,0 +1,67 @@
+//! pqueue_concurrentと、mutexで保護したpqueue_heapのスループット比較
+/*!
+	各スレッドがpush, pop_frontを交互に行う
+	usage: bench_pqueue_concurrent [1スレッドあたりの操作数] [初期要素数] [最大スレッド数]
+*/
+#include "../pqueue_concurrent.hpp"
+#include "bench.hpp"
+#include <mutex>
+#include <cstdint>
+
+namespace {
+	using value_t = uint64_t;
+	//! 全体を1つのロックで保護したヒープ
+	class LockedHeap {
+		private:
+			std::mutex						_mutex;
+			spi::pqueue_heap<value_t>		_heap;
+		public:
+			void push(const value_t v) {
+				std::lock_guard lk(_mutex);
+				_heap.push(v);
+			}
+			bool pop_front(value_t& dst) {
+				std::lock_guard lk(_mutex);
+				if(_heap.empty())
+					return false;
+				_heap.pop_front(dst);
+				return true;
+			}
+	};
+	uint64_t Next(uint64_t& s) noexcept {
+		s ^= s << 13;
+		s ^= s >> 7;
+		s ^= s << 17;
+		return s;
+	}
+	//! 1秒あたりの操作数(百万)
+	template <class Q>
+	double Run(Q& q, const std::size_t nThread, const std::size_t nOp, const std::size_t nInit) {
+		uint64_t s = 1;
+		for(std::size_t i=0 ; i<nInit ; i++)
+			q.push(Next(s) & 0xffffff);
+		const double sec = spi::bench::Measure(nThread, [&q, nOp](const std::size_t idx){
+			uint64_t s = idx*2 + 1;
+			value_t v;
+			for(std::size_t i=0 ; i<nOp ; i+=2) {
+				q.push(Next(s) & 0xffffff);
+				q.pop_front(v);
+			}
+		});
+		return double(nThread * nOp) / sec / 1e6;
+	}
+}
+int main(const int argc, char** argv) {
+	const std::size_t nOp = spi::bench::Arg(argc, argv, 1, 1 << 20),
+					nInit = spi::bench::Arg(argc, argv, 2, 1 << 16),
+					maxThread = spi::bench::Arg(argc, argv, 3, 0);
+	std::printf("threads\tlocked_heap[Mops/s]\tpqueue_concurrent[Mops/s]\n");
+	for(const auto nThread : spi::bench::ThreadCounts(maxThread)) {
+		LockedHeap lh;
+		spi::pqueue_concurrent<value_t> pc(nThread);
+		const double r0 = Run(lh, nThread, nOp, nInit),
+					r1 = Run(pc, nThread, nOp, nInit);
+		std::printf("%zu\t%.2f\t%.2f\n", nThread, r0, r1);
+	}
+	return 0;
+}
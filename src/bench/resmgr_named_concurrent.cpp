@@ -0,0 +1,122 @@
+//! ResMgrNameConcurrent::get()と、mutexで保護したResMgrName::get()のスループット比較
+/*!
+	最初に1スレッドでのリソースの登録、解放時間を計り、
+	次にあらかじめ登録したリソースを各スレッドがランダムなキーで検索する
+	writeIntervalを指定すると、各スレッドがその回数毎に1度、自分専用のキーでリソースを作り直す
+	usage: bench_resmgr_named_concurrent [1スレッドあたりの検索数] [キー数] [最大スレッド数] [writeInterval(0なら書き込み無し)]
+*/
+#include "../resmgr_named_concurrent.hpp"
+#include "bench.hpp"
+#include <mutex>
+#include <string>
+#include <cstdint>
+
+namespace {
+	using value_t = uint64_t;
+	//! 全体を1つのロックで保護したマネージャ
+	class LockedMgr {
+		private:
+			using Mgr = spi::ResMgrName<value_t>;
+			std::mutex	_mutex;
+			Mgr			_mgr;
+		public:
+			using shared_t = Mgr::shared_t;
+			shared_t emplace(const std::string& k, const value_t v) {
+				std::lock_guard lk(_mutex);
+				return _mgr.emplace(k, v).first;
+			}
+			shared_t get(const std::string& k) {
+				std::lock_guard lk(_mutex);
+				return _mgr.get(k);
+			}
+			shared_t replace(const std::string& k, const value_t v) {
+				std::lock_guard lk(_mutex);
+				return _mgr.replaceEmplace(k, nullptr, v).first;
+			}
+	};
+	class ConcurrentMgr {
+		private:
+			using Mgr = spi::ResMgrNameConcurrent<value_t>;
+			Mgr		_mgr;
+		public:
+			using shared_t = Mgr::shared_t;
+			shared_t emplace(const std::string& k, const value_t v) {
+				return _mgr.emplace(k, v).first;
+			}
+			shared_t get(const std::string& k) {
+				return _mgr.get(k);
+			}
+			shared_t replace(const std::string& k, const value_t v) {
+				return _mgr.replaceEmplace(k, nullptr, v).first;
+			}
+	};
+	uint64_t Next(uint64_t& s) noexcept {
+		s ^= s << 13;
+		s ^= s >> 7;
+		s ^= s << 17;
+		return s;
+	}
+	//! nKey個のリソースを1スレッドで登録し、全て解放するまでの時間(ms)
+	template <class M>
+	std::pair<double, double> Load(const std::size_t nKey) {
+		M mgr;
+		std::vector<typename M::shared_t> hold(nKey);
+		const auto t0 = std::chrono::steady_clock::now();
+		for(std::size_t i=0 ; i<nKey ; i++)
+			hold[i] = mgr.emplace("resource_" + std::to_string(i), i);
+		const auto t1 = std::chrono::steady_clock::now();
+		hold.clear();
+		const auto t2 = std::chrono::steady_clock::now();
+		using ms = std::chrono::duration<double, std::milli>;
+		return {ms(t1 - t0).count(), ms(t2 - t1).count()};
+	}
+	//! 1秒あたりの検索数(百万)
+	template <class M>
+	double Run(const std::size_t nThread, const std::size_t nOp, const std::size_t nKey, const std::size_t writeInterval) {
+		M mgr;
+		std::vector<std::string> key(nKey);
+		std::vector<typename M::shared_t> hold(nKey);
+		for(std::size_t i=0 ; i<nKey ; i++) {
+			key[i] = "resource_" + std::to_string(i);
+			hold[i] = mgr.emplace(key[i], i);
+		}
+		std::atomic<std::size_t> nFound(0);
+		const double sec = spi::bench::Measure(nThread, [&](const std::size_t idx){
+			uint64_t s = idx*2 + 1;
+			const std::string own = "writer_" + std::to_string(idx);
+			typename M::shared_t ownRes;
+			std::size_t found = 0;
+			for(std::size_t i=0 ; i<nOp ; i++) {
+				if(writeInterval != 0 && i % writeInterval == 0)
+					ownRes = mgr.replace(own, i);
+				if(mgr.get(key[Next(s) % nKey]))
+					++found;
+			}
+			nFound += found;
+		});
+		// 全て見つかるはず(最適化で検索が消されないようにも使う)
+		if(nFound.load() != nThread * nOp)
+			std::fprintf(stderr, "unexpected miss\n");
+		return double(nThread * nOp) / sec / 1e6;
+	}
+}
+int main(const int argc, char** argv) {
+	const std::size_t nOp = spi::bench::Arg(argc, argv, 1, 1 << 20),
+					nKey = std::max<std::size_t>(spi::bench::Arg(argc, argv, 2, 1024), 1),
+					maxThread = spi::bench::Arg(argc, argv, 3, 0),
+					writeInterval = spi::bench::Arg(argc, argv, 4, 0);
+	{
+		const auto l0 = Load<LockedMgr>(nKey),
+					l1 = Load<ConcurrentMgr>(nKey);
+		std::printf("load %zu keys\tlocked_resmgr[ms]\tresmgr_concurrent[ms]\n", nKey);
+		std::printf("emplace\t%.2f\t%.2f\n", l0.first, l1.first);
+		std::printf("release\t%.2f\t%.2f\n", l0.second, l1.second);
+	}
+	std::printf("threads\tlocked_resmgr[Mget/s]\tresmgr_concurrent[Mget/s]\n");
+	for(const auto nThread : spi::bench::ThreadCounts(maxThread)) {
+		const double r0 = Run<LockedMgr>(nThread, nOp, nKey, writeInterval),
+					r1 = Run<ConcurrentMgr>(nThread, nOp, nKey, writeInterval);
+		std::printf("%zu\t%.2f\t%.2f\n", nThread, r0, r1);
+	}
+	return 0;
+}
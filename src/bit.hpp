@@ -0,0 +1,23 @@
+#pragma once
+#include <limits>
+#include <type_traits>
+#include <cstddef>
+
+namespace spi {
+	//! 最上位の1のビット位置+1 (0なら0)
+	template <class T>
+	std::size_t BitWidth(const T x) noexcept {
+		static_assert(std::is_unsigned_v<T>, "BitWidth requires unsigned integer");
+		static_assert(sizeof(T) <= sizeof(unsigned long long), "");
+		#ifdef __GNUC__
+			if(x == 0)
+				return 0;
+			return std::numeric_limits<unsigned long long>::digits - __builtin_clzll(x);
+		#else
+			std::size_t ret = 0;
+			for(T t=x ; t!=0 ; t>>=1)
+				++ret;
+			return ret;
+		#endif
+	}
+}
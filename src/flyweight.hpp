@@ -1,86 +1,468 @@
 #pragma once
 #include "lubee/src/error.hpp"
+#include "lubee/src/meta/enable_if.hpp"
 #include <unordered_set>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <string_view>
+#include <string>
+#include <algorithm>
 
 namespace spi {
-	template <class T, class F_Hash=std::hash<T>, class F_Cmp=std::equal_to<>>
+	namespace flyweight {
+		//! std::string, std::string_view, const char*を同じハッシュ値で扱う(make()での異種検索用)
+		struct StringHash {
+			using is_transparent = void;
+			std::size_t operator()(const std::string_view s) const noexcept {
+				// std::hash<std::string>とstd::hash<std::string_view>は同じ値を返す
+				return std::hash<std::string_view>()(s);
+			}
+		};
+		namespace detail {
+			template <class T, class = void>
+			struct is_transparent : std::false_type {};
+			template <class T>
+			struct is_transparent<T, std::void_t<typename T::is_transparent>> : std::true_type {};
+
+			constexpr std::size_t Log2(const std::size_t n) noexcept {
+				return n <= 1 ? 0 : 1 + Log2(n >> 1);
+			}
+			//! ハッシュ値からシャードの番号を求める
+			/*! テーブル内のバケット選択と相関しないよう、ハッシュ値を撹拌して上位ビットを使う */
+			template <std::size_t NShard>
+			std::size_t ShardIndex(const std::size_t hash) noexcept {
+				if constexpr (NShard == 1)
+					return 0;
+				else {
+					const uint64_t h = uint64_t(hash) * 0x9e3779b97f4a7c15ull;
+					return h >> (64 - Log2(NShard));
+				}
+			}
+		}
+		//! 排他制御をしない(シングルスレッド用)
+		struct NoMutex {
+			void lock() noexcept {}
+			void unlock() noexcept {}
+		};
+		//! 単一のテーブル、排他制御無し(デフォルト)
+		struct Single {
+			constexpr static std::size_t NShard = 1;
+			using Mutex = NoMutex;
+		};
+		//! ハッシュ値でN個に分割したテーブルをそれぞれmutexで保護する
+		/*! 複数スレッドから同時にmake, 値の解放をしても良い */
+		template <std::size_t N=16>
+		struct Sharded {
+			static_assert(N > 0 && (N & (N-1)) == 0, "number of shards should be power of 2");
+			constexpr static std::size_t NShard = N;
+			using Mutex = std::mutex;
+		};
+		//! Stats::iterate()で列挙する名前("<prefix>.Hit"など)
+		/*!
+			名前の文字列はこのオブジェクトが保持するので、
+			プロファイラの様に名前のポインタを保持する側より長く生存させること
+		*/
+		class StatsKey {
+			public:
+				enum Item {
+					Value,
+					Hit,
+					Miss,
+					HitRate,
+					Reference,
+					Expired,
+					BytesSaved,
+					Bucket,
+					Collision,
+					MaxBucketSize,
+					LoadFactor,
+					_Num
+				};
+			private:
+				std::array<std::string, _Num>	_key;
+			public:
+				explicit StatsKey(const std::string_view prefix = "Flyweight") {
+					constexpr const char* c_name[_Num] = {
+						"Value", "Hit", "Miss", "HitRate", "Reference", "Expired",
+						"BytesSaved", "Bucket", "Collision", "MaxBucketSize", "LoadFactor"
+					};
+					for(int i=0 ; i<_Num ; i++) {
+						_key[i].reserve(prefix.size() + 1 + std::char_traits<char>::length(c_name[i]));
+						_key[i].append(prefix).append(1, '.').append(c_name[i]);
+					}
+				}
+				const char* operator[](const Item item) const noexcept {
+					return _key[item].c_str();
+				}
+		};
+		//! Flyweightの統計情報
+		struct Stats {
+			// ---- 常に集計 ----
+			std::size_t	nValue = 0,			//!< 生存している値の数
+						nHit = 0,			//!< make()で既存の値を共有した回数
+						nMiss = 0;			//!< make()で値を新しく作った回数
+			// ---- Flyweight::stats(true)の時のみ集計(全エントリを走査する) ----
+			std::size_t	nReference = 0,		//!< 値への参照の総数
+						nExpired = 0,		//!< 参照が無くなり、テーブルからの削除待ちになっている値の数
+						bytesSaved = 0,		//!< 共有によって節約したバイト数の概算((nReference-nValue) * sizeof(value))
+						nBucket = 0,		//!< ハッシュテーブルのバケット数
+						nCollision = 0,		//!< 他の値とバケットを共有している値の数
+						maxBucketSize = 0;	//!< 1つのバケットに入っている値の最大数
+
+			//! ヒット率(make()を呼んでいなければ0)
+			double hitRate() const noexcept {
+				const std::size_t n = nHit + nMiss;
+				return n == 0 ? 0.0 : double(nHit) / double(n);
+			}
+			//! バケットあたりの値の数
+			double loadFactor() const noexcept {
+				return nBucket == 0 ? 0.0 : double(nValue) / double(nBucket);
+			}
+			//! keyの名前と値を列挙(f(const char* name, double value))
+			template <class F>
+			void iterate(const StatsKey& key, F&& f) const {
+				using K = StatsKey;
+				f(key[K::Value], double(nValue));
+				f(key[K::Hit], double(nHit));
+				f(key[K::Miss], double(nMiss));
+				f(key[K::HitRate], hitRate());
+				f(key[K::Reference], double(nReference));
+				f(key[K::Expired], double(nExpired));
+				f(key[K::BytesSaved], double(bytesSaved));
+				f(key[K::Bucket], double(nBucket));
+				f(key[K::Collision], double(nCollision));
+				f(key[K::MaxBucketSize], double(maxBucketSize));
+				f(key[K::LoadFactor], loadFactor());
+			}
+			//! 名前を結び付けた統計情報
+			struct Named {
+				const Stats&	stats;
+				const StatsKey&	key;
+
+				template <class F>
+				void iterate(F&& f) const {
+					stats.iterate(key, std::forward<F>(f));
+				}
+			};
+			//! profiler.setValues(stats.named(key))でプロファイラに記録できる
+			Named named(const StatsKey& key) const noexcept {
+				return {*this, key};
+			}
+		};
+	}
+	//! 同じ値を1つのインスタンスにまとめる
+	/*!
+		\tparam Policy	flyweight::Single or flyweight::Sharded<N>
+	*/
+	template <class T, class F_Hash=std::hash<T>, class F_Cmp=std::equal_to<>, class Policy=flyweight::Single>
 	class Flyweight {
 		private:
 			using value_t = T;
 		public:
 			using SP = std::shared_ptr<const value_t>;
 		private:
-			struct WP {
-				using P = std::weak_ptr<const value_t>;
-				P				wp;
-				const value_t*	ptr = nullptr;
-				std::size_t		hash_value;
+			struct Node;
+			//! テーブルの要素
+			/*! 値が解放される時に自身を削除するので、テーブルには生存している値しか無い */
+			struct Entry {
+				//! 値へのポインタ(検索時はweak_ptrを介さずにこれを直接比較する)
+				const value_t*			ptr;
+				//! 値を共有する為のポインタ(検索でヒットした時のみ参照)
+				mutable std::weak_ptr<const value_t>	wp;
+				std::size_t				hash_value;
+				mutable Node*			node = nullptr;
+				//! value_t以外の型で検索する時の比較関数(ptrの代わりにkeyを比較に使う)
+				using Cmp = bool (*)(const value_t&, const void*);
+				Cmp						cmp = nullptr;
+				const void*				key = nullptr;
 
-				WP(const SP& sp):
-					wp(sp),
-					hash_value(F_Hash()(*sp))
-				{}
-				WP(const value_t* ptr):
+				Entry(const value_t* ptr):
 					ptr(ptr),
 					hash_value(F_Hash()(*ptr))
 				{}
+				Entry(const value_t* ptr, const std::size_t hash):
+					ptr(ptr),
+					hash_value(hash)
+				{}
+				//! 異種検索用
+				struct Lookup {};
+				template <class K>
+				Entry(Lookup, const K& k, const std::size_t hash):
+					ptr(nullptr),
+					hash_value(hash),
+					cmp([](const value_t& v, const void* k){
+						return F_Cmp()(v, *static_cast<const K*>(k));
+					}),
+					key(&k)
+				{}
+			};
+			struct Hash {
+				std::size_t operator()(const Entry& e) const noexcept {
+					return e.hash_value;
+				}
+			};
+			struct Equal {
+				bool operator()(const Entry& e0, const Entry& e1) const noexcept {
+					// 異種検索の場合は、どちらか一方が検索用のエントリ
+					if(e0.cmp)
+						return e0.cmp(*e1.ptr, e0.key);
+					if(e1.cmp)
+						return e1.cmp(*e0.ptr, e1.key);
+					return e0.ptr == e1.ptr || F_Cmp()(*e0.ptr, *e1.ptr);
+				}
+			};
+			using Set = std::unordered_set<Entry, Hash, Equal>;
+			using Mutex = typename Policy::Mutex;
+			constexpr static std::size_t NShard = Policy::NShard;
+			//! ハッシュ値は計算済みの物を使い、ポインタの一致でエントリを特定
+			static typename Set::const_iterator _find(const Set& set, const Entry& e) {
+				const auto range = set.equal_range(Entry(e.ptr, e.hash_value));
+				for(auto itr = range.first ; itr != range.second ; ++itr) {
+					if(&*itr == &e)
+						return itr;
+				}
+				D_Assert0(false);
+				return set.end();
+			}
+			// 隣のシャードとキャッシュラインを共有しないようにする
+			struct alignas(64) Shard {
+				Mutex		mutex;
+				Set			set;
+				//! 統計情報(シャードのロック下で更新)
+				std::size_t	nHit = 0,
+							nMiss = 0;
+			};
+			//! 値よりテーブルが先に破棄されても良いよう、共有して保持する
+			struct Core {
+				std::array<Shard, NShard>	shard;
 
-				bool operator == (const WP& w) const noexcept {
-					const SP sp0 = wp.lock(),
-							sp1 = w.wp.lock();
-					const value_t *p0, *p1;
-					p0 = ptr ? ptr : sp0.get();
-					p1 = w.ptr ? w.ptr : sp1.get();
-					if(!p1) {
-						return F_Cmp()(p0, nullptr);
-					}
-					return F_Cmp()(*p0, *p1);
+				Shard& getShard(const std::size_t hash) noexcept {
+					return shard[flyweight::detail::ShardIndex<NShard>(hash)];
+				}
+				//! 値が解放される直前に呼ばれる
+				void release(Node& n) {
+					// テーブルに登録されていない、またはmake()で既に外されている場合は何もしない
+					if(!n.entry.load(std::memory_order_acquire))
+						return;
+					auto& s = getShard(n.hash_value);
+					std::lock_guard lk(s.mutex);
+					if(const auto* e = n.entry.load(std::memory_order_relaxed))
+						s.set.erase(_find(s.set, *e));
 				}
 			};
-			struct Hash {
-				std::size_t operator()(const WP& w) const noexcept {
-					return w.hash_value;
+			using Core_SP = std::shared_ptr<Core>;
+			//! 値と、テーブル上の自身のエントリを1つの領域に確保する
+			struct Node {
+				value_t			value;
+				Core_SP			core;
+				std::size_t		hash_value;
+				//! テーブル上のエントリ(書き換えはシャードのロック下で行う)
+				std::atomic<const Entry*>	entry{nullptr};
+
+				template <class V>
+				Node(V&& v, const Core_SP& core, const std::size_t hash):
+					value(std::forward<V>(v)),
+					core(core),
+					hash_value(hash)
+				{}
+				~Node() {
+					core->release(*this);
 				}
 			};
-			using Set = std::unordered_set<WP, Hash>;
-			Set			_set;
+			Core_SP		_core = std::make_shared<Core>();
+
+			template <class K>
+			constexpr static bool _CanLookup() noexcept {
+				if constexpr (flyweight::detail::is_transparent<F_Hash>{} && flyweight::detail::is_transparent<F_Cmp>{})
+					return std::is_invocable_r_v<std::size_t, const F_Hash&, const K&> &&
+							std::is_invocable_r_v<bool, const F_Cmp&, const value_t&, const K&>;
+				else
+					return false;
+			}
+			//! 検索し、無ければmakeValue()の戻り値で値を作る
+			template <class MakeValue>
+			SP _make(const Entry& probe, MakeValue&& makeValue) {
+				auto& s = _core->getShard(probe.hash_value);
+				std::lock_guard lk(s.mutex);
+				auto& set = s.set;
+				{
+					const auto itr = set.find(probe);
+					if(itr != set.end()) {
+						if(auto sp = itr->wp.lock()) {
+							++s.nHit;
+							return sp;
+						}
+						// 他のスレッドで最後の参照が外れ、解放処理がロック待ちになっている
+						// -> エントリを先に外しておき、新しく作り直す
+						// (nullptrを見た解放処理は値を破棄するので、比較を終えた後にreleaseで書き込む)
+						Node* n = itr->node;
+						set.erase(itr);
+						n->entry.store(nullptr, std::memory_order_release);
+					}
+				}
+				const auto node = std::make_shared<Node>(makeValue(), _core, probe.hash_value);
+				++s.nMiss;
+				const auto [itr, added] = set.emplace(&node->value, probe.hash_value);
+				D_Assert0(added);
+				itr->node = node.get();
+				node->entry.store(&*itr, std::memory_order_relaxed);
+				SP ret(node, &node->value);
+				itr->wp = ret;
+				return ret;
+			}
 
 		public:
-			std::size_t gc() {
-				const auto prev = _set.size();
-				auto itr = _set.begin();
-				while(itr != _set.end()) {
-					if(itr->wp.expired()) {
-						itr = _set.erase(itr);
-					} else
-						++itr;
+			//! テーブルから外した値を直接書き換える為のハンドル(detach()で取得)
+			class Detached {
+				private:
+					friend class Flyweight;
+					Node*	_node = nullptr;
+				public:
+					explicit operator bool () const noexcept {
+						return _node != nullptr;
+					}
+					value_t& value() const noexcept {
+						D_Assert0(_node);
+						return _node->value;
+					}
+			};
+			Flyweight() = default;
+			Flyweight(const Flyweight&) = delete;
+			Flyweight& operator = (const Flyweight&) = delete;
+
+			//! 解放済みの値のエントリを削除
+			/*! エントリは値の解放時に削除されるので、常に0を返す(互換性の為に残している) */
+			std::size_t gc() noexcept {
+				return 0;
+			}
+			//! 生存している値の数
+			std::size_t size() const {
+				std::size_t ret = 0;
+				for(auto& s : _core->shard) {
+					std::lock_guard lk(s.mutex);
+					ret += s.set.size();
+				}
+				return ret;
+			}
+			//! 値の参照がspだけならテーブルから外し、値を直接書き換えられるようにする
+			/*!
+				外している間は同じ値をmake()しても共有されない
+				書き換えた後はattach()でテーブルに戻す
+				\return 他にも参照がある場合は無効なハンドル(値をコピーして書き換える必要がある)
+			*/
+			Detached detach(const SP& sp) {
+				Detached ret;
+				if(!sp)
+					return ret;
+				const std::size_t hash = F_Hash()(*sp);
+				auto& s = _core->getShard(hash);
+				std::lock_guard lk(s.mutex);
+				// 参照を増やせるのはロック下のmake()だけなので、ここで1なら外すまで他から共有されることは無い
+				if(sp.use_count() != 1)
+					return ret;
+				auto& set = s.set;
+				const auto range = set.equal_range(Entry(sp.get(), hash));
+				for(auto itr = range.first ; itr != range.second ; ++itr) {
+					if(itr->ptr == sp.get()) {
+						ret._node = itr->node;
+						ret._node->entry.store(nullptr, std::memory_order_relaxed);
+						set.erase(itr);
+						break;
+					}
 				}
-				return prev - _set.size();
+				return ret;
+			}
+			//! detach()で外した値を、書き換え後のハッシュ値でテーブルに戻す
+			/*!
+				\param[in] sp	detach()に渡したポインタ
+				\return 同じ値が既に登録されていればそちらを、無ければspを返す
+			*/
+			SP attach(SP sp, const Detached& d) {
+				D_Assert0(d && sp.get() == &d._node->value);
+				Node& node = *d._node;
+				const std::size_t hash = F_Hash()(node.value);
+				auto& s = _core->getShard(hash);
+				std::lock_guard lk(s.mutex);
+				auto& set = s.set;
+				{
+					const auto itr = set.find(Entry(&node.value, hash));
+					if(itr != set.end()) {
+						// 書き換えた値は登録されていないので、spの解放時にテーブルは操作しない
+						if(auto ret = itr->wp.lock())
+							return ret;
+						Node* n = itr->node;
+						set.erase(itr);
+						n->entry.store(nullptr, std::memory_order_release);
+					}
+				}
+				node.hash_value = hash;
+				const auto [itr, added] = set.emplace(&node.value, hash);
+				D_Assert0(added);
+				itr->node = &node;
+				itr->wp = sp;
+				node.entry.store(&*itr, std::memory_order_relaxed);
+				return sp;
+			}
+			//! 統計情報を取得
+			/*!
+				\param[in] scan	trueなら全エントリを走査し、参照数やバケットの情報も集計する
+								(falseならシャード数分のロックのみで済む)
+			*/
+			flyweight::Stats stats(const bool scan=false) const {
+				flyweight::Stats ret;
+				for(auto& s : _core->shard) {
+					std::lock_guard lk(s.mutex);
+					auto& set = s.set;
+					ret.nValue += set.size();
+					ret.nHit += s.nHit;
+					ret.nMiss += s.nMiss;
+					if(!scan)
+						continue;
+					for(auto& e : set) {
+						const std::size_t n = e.wp.use_count();
+						if(n == 0)
+							++ret.nExpired;
+						else {
+							ret.nReference += n;
+							ret.bytesSaved += (n-1) * sizeof(value_t);
+						}
+					}
+					ret.nBucket += set.bucket_count();
+					for(std::size_t i=0 ; i<set.bucket_count() ; i++) {
+						const std::size_t n = set.bucket_size(i);
+						if(n > 1)
+							ret.nCollision += n;
+						ret.maxBucketSize = std::max(ret.maxBucketSize, n);
+					}
+				}
+				return ret;
 			}
 			template <
 				class V,
 				ENABLE_IF((std::is_same_v<std::decay_t<V>, value_t>))
 			>
 			SP make(V&& v) {
-				{
-					const auto itr = _set.find(WP(&v));
-					if(itr != _set.end()) {
-						if(const auto sp = itr->wp.lock())
-							return sp;
-						_set.erase(itr);
-					}
-				}
-				SP ret = std::make_shared<const value_t>(std::forward<V>(v));
-				_set.emplace(WP(ret));
-				return ret;
+				const Entry probe(&v);
+				return _make(probe, [&v]() -> V&& { return std::forward<V>(v); });
 			}
+			//! value_t以外の型から値を作る
+			/*!
+				F_HashとF_Cmpが共にis_transparentを持ち、その型で呼び出せる場合はvalue_tを構築せずに検索し、
+				テーブルに無かった時だけvalue_tを作る
+				(F_Hash(v)はF_Hash(value_t(v))と同じ値を返さなければならない)
+			*/
 			template <
 				class V,
 				ENABLE_IF(!(std::is_same_v<std::decay_t<V>, value_t>))
 			>
 			SP make(V&& v) {
-				return make(value_t(std::forward<V>(v)));
+				if constexpr (_CanLookup<std::remove_reference_t<V>>()) {
+					const Entry probe(typename Entry::Lookup{}, v, F_Hash()(v));
+					return _make(probe, [&v](){ return value_t(std::forward<V>(v)); });
+				} else
+					return make(value_t(std::forward<V>(v)));
 			}
 	};
 }
@@ -0,0 +1,362 @@
+#pragma once
+#include "flyweight.hpp"
+#include "bit.hpp"
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+namespace spi {
+	namespace flyweight {
+		//! FlyweightIdの値を保持するテーブル
+		/*!
+			値はハッシュ値でPolicy::NShard個のシャードに分け、シャード毎のロックで保護する
+			IDの上位ビットがシャード番号なので、値の解放やスロットの再利用は常に同じシャードの中で行われる
+			値はシャード毎に倍々の大きさのセグメントに確保するので、一度確保した値のアドレスは変わらない
+			(IDから値を引く時にロックを必要としない)
+		*/
+		template <class T, class F_Hash, class F_Cmp, class Policy, bool RefCount>
+		class IdTable {
+			public:
+				using id_t = uint32_t;
+				constexpr static id_t InvalidId = ~id_t(0);
+			private:
+				using value_t = T;
+				using Mutex = typename Policy::Mutex;
+				constexpr static std::size_t NShard = Policy::NShard,
+											ShardBit = detail::Log2(NShard),
+											LocalBit = 32 - ShardBit,
+											BaseBit = 6,
+											Base = std::size_t(1) << BaseBit,
+											NSegment = LocalBit - BaseBit + 1;
+				static_assert(LocalBit > BaseBit, "too many shards");
+				//! シャード内の番号の上限(全てのビットが立つとInvalidIdと区別できないので含まない)
+				constexpr static id_t MaxLocal = id_t((uint64_t(1) << LocalBit) - 1);
+				struct alignas(value_t) Storage {
+					uint8_t		data[sizeof(value_t)];
+				};
+				struct SlotBase {
+					Storage		storage;
+					bool		used = false;
+
+					value_t& value() noexcept {
+						return *reinterpret_cast<value_t*>(storage.data);
+					}
+				};
+				//! 参照カウント有りの場合は、解放時にテーブルから外す為のハッシュ値も持つ
+				struct SlotRC : SlotBase {
+					std::atomic<uint32_t>	count{0};
+					std::size_t				hash_value;
+				};
+				using Slot = std::conditional_t<RefCount, SlotRC, SlotBase>;
+				using SegA = std::array<std::atomic<Slot*>, NSegment>;
+				//! ハッシュ値 -> ID
+				using Map = std::unordered_multimap<std::size_t, id_t>;
+				using FreeV = std::vector<id_t>;
+				// 隣のシャードとキャッシュラインを共有しないようにする
+				struct alignas(64) Shard {
+					Mutex		mutex;
+					SegA		segment = {};
+					Map			map;
+					FreeV		free;			//!< 空いているシャード内の番号
+					id_t		nSlot = 0;
+				};
+				std::array<Shard, NShard>	_shard;
+
+				//! セグメントsの要素数
+				constexpr static std::size_t _SegmentSize(const std::size_t s) noexcept {
+					return Base << s;
+				}
+				//! シャード内の番号 -> (セグメント, セグメント内の位置)
+				static std::pair<std::size_t, std::size_t> _Locate(const id_t local) noexcept {
+					// セグメントsは[Base*(2^s-1), Base*(2^(s+1)-1))の番号を受け持つ
+					const std::size_t x = std::size_t(local) + Base,
+									s = BitWidth(x) - 1 - BaseBit;
+					return {s, x - (std::size_t(1) << (s + BaseBit))};
+				}
+				static std::size_t _ShardOf(const id_t id) noexcept {
+					if constexpr (NShard == 1)
+						return 0;
+					else
+						return id >> LocalBit;
+				}
+				static id_t _LocalOf(const id_t id) noexcept {
+					return id & MaxLocal;
+				}
+				Slot& _slot(const id_t id) const noexcept {
+					const auto [s, idx] = _Locate(_LocalOf(id));
+					Slot* seg = _shard[_ShardOf(id)].segment[s].load(std::memory_order_acquire);
+					D_Assert0(seg);
+					return seg[idx];
+				}
+				//! ロック済みのシャードに空きスロットを確保
+				static id_t _AllocSlot(Shard& sh, const std::size_t shardIdx) {
+					id_t local;
+					if(!sh.free.empty()) {
+						local = sh.free.back();
+						sh.free.pop_back();
+					} else {
+						D_Assert(sh.nSlot != MaxLocal, "too many values");
+						local = sh.nSlot++;
+						const std::size_t s = _Locate(local).first;
+						if(!sh.segment[s].load(std::memory_order_relaxed))
+							sh.segment[s].store(new Slot[_SegmentSize(s)], std::memory_order_release);
+					}
+					return id_t(shardIdx << LocalBit) | local;
+				}
+				template <class Cmp>
+				id_t _find(const Shard& sh, const std::size_t hash, Cmp&& cmp) const {
+					const auto range = sh.map.equal_range(hash);
+					for(auto itr = range.first ; itr != range.second ; ++itr) {
+						if(cmp(_slot(itr->second).value()))
+							return itr->second;
+					}
+					return InvalidId;
+				}
+
+			public:
+				IdTable() = default;
+				IdTable(const IdTable&) = delete;
+				~IdTable() {
+					for(auto& sh : _shard) {
+						for(std::size_t s=0 ; s<NSegment ; s++) {
+							if(Slot* seg = sh.segment[s].load()) {
+								for(std::size_t i=0 ; i<_SegmentSize(s) ; i++) {
+									if(seg[i].used)
+										seg[i].value().~value_t();
+								}
+								delete[] seg;
+							}
+						}
+					}
+				}
+				//! 値を登録してIDを返す
+				/*!
+					\param[in] hash			値のハッシュ値
+					\param[in] cmp			登録済みの値と比較する関数
+					\param[in] makeValue	登録されていなかった場合に値を作る関数
+				*/
+				template <class Cmp, class MakeValue>
+				id_t make(const std::size_t hash, Cmp&& cmp, MakeValue&& makeValue) {
+					const std::size_t shardIdx = detail::ShardIndex<NShard>(hash);
+					auto& sh = _shard[shardIdx];
+					std::lock_guard lk(sh.mutex);
+					id_t id = _find(sh, hash, cmp);
+					if(id != InvalidId) {
+						if constexpr (RefCount) {
+							// 参照カウントが0になって解放待ちの値もここで復活させる
+							_slot(id).count.fetch_add(1, std::memory_order_relaxed);
+						}
+						return id;
+					}
+					id = _AllocSlot(sh, shardIdx);
+					auto& sl = _slot(id);
+					try {
+						new(sl.storage.data) value_t(makeValue());
+					} catch(...) {
+						sh.free.push_back(_LocalOf(id));
+						throw;
+					}
+					if constexpr (RefCount) {
+						sl.hash_value = hash;
+						sl.count.store(1, std::memory_order_relaxed);
+					}
+					sl.used = true;
+					sh.map.emplace(hash, id);
+					return id;
+				}
+				const value_t& get(const id_t id) const noexcept {
+					return _slot(id).value();
+				}
+				void addRef(const id_t id) noexcept {
+					static_assert(RefCount, "");
+					_slot(id).count.fetch_add(1, std::memory_order_relaxed);
+				}
+				void release(const id_t id) {
+					static_assert(RefCount, "");
+					auto& sl = _slot(id);
+					if(sl.count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+						return;
+					auto& sh = _shard[_ShardOf(id)];
+					std::lock_guard lk(sh.mutex);
+					// ロックを待つ間に復活、または別の解放処理で削除済みの場合は何もしない
+					// (スロットの再利用は同じシャードのロック下でしか行われない)
+					if(!sl.used || sl.count.load(std::memory_order_relaxed) != 0)
+						return;
+					const auto range = sh.map.equal_range(sl.hash_value);
+					for(auto itr = range.first ; itr != range.second ; ++itr) {
+						if(itr->second == id) {
+							sh.map.erase(itr);
+							break;
+						}
+					}
+					sl.value().~value_t();
+					sl.used = false;
+					sh.free.push_back(_LocalOf(id));
+				}
+				//! 登録されている値の数
+				std::size_t size() {
+					std::size_t ret = 0;
+					for(auto& sh : _shard) {
+						std::lock_guard lk(sh.mutex);
+						ret += sh.map.size();
+					}
+					return ret;
+				}
+				//! 型毎に共有するテーブル
+				static IdTable& Get() {
+					// プログラム終了時に他の静的変数より先に破棄されないよう、解放はしない
+					static IdTable* t = new IdTable;
+					return *t;
+				}
+		};
+		//! IDの保持(参照カウント無し: トリビアルにコピーできる)
+		template <class Table, bool RefCount>
+		struct IdHolder {
+			typename Table::id_t	id = Table::InvalidId;
+		};
+		//! IDの保持(参照カウント有り)
+		template <class Table>
+		struct IdHolder<Table, true> {
+			using id_t = typename Table::id_t;
+			id_t	id = Table::InvalidId;
+
+			IdHolder() = default;
+			IdHolder(const id_t id) noexcept:
+				id(id)
+			{}
+			IdHolder(const IdHolder& h) noexcept:
+				id(h.id)
+			{
+				if(id != Table::InvalidId)
+					Table::Get().addRef(id);
+			}
+			IdHolder(IdHolder&& h) noexcept:
+				id(h.id)
+			{
+				h.id = Table::InvalidId;
+			}
+			~IdHolder() {
+				if(id != Table::InvalidId)
+					Table::Get().release(id);
+			}
+			IdHolder& operator = (const IdHolder& h) noexcept {
+				IdHolder tmp(h);
+				std::swap(id, tmp.id);
+				return *this;
+			}
+			IdHolder& operator = (IdHolder&& h) noexcept {
+				std::swap(id, h.id);
+				return *this;
+			}
+		};
+	}
+	//! 値を32bitのIDで参照するFlyweight
+	/*!
+		値は型毎に共有されるテーブルに格納し、アイテム自体はIDのみを持つ
+		比較とハッシュ値はIDそのものなので、FlyweightItem(shared_ptr)よりコピーや比較が軽い
+		\tparam RefCount	falseなら一度登録した値は解放しない(コピーはIDのコピーのみ)
+							trueなら参照カウントが0になった値を解放し、IDを再利用する
+		\tparam Policy		flyweight::Singleなら単一スレッド専用、flyweight::Sharded<N>ならテーブルをN個に分割してそれぞれmutexで保護する
+							(IDから値を引く処理はロックしない)
+	*/
+	template <
+		class T,
+		class F_Hash=std::hash<T>,
+		class F_Cmp=std::equal_to<>,
+		bool RefCount=false,
+		class Policy=flyweight::Single
+	>
+	class FlyweightId {
+		public:
+			using value_t = T;
+			using Table = flyweight::IdTable<T, F_Hash, F_Cmp, Policy, RefCount>;
+			using id_t = typename Table::id_t;
+			constexpr static id_t InvalidId = Table::InvalidId;
+		private:
+			flyweight::IdHolder<Table, RefCount>	_h;
+
+			static Table& _Table() {
+				return Table::Get();
+			}
+			template <class V>
+			static id_t _Make(V&& v) {
+				if constexpr (std::is_same_v<std::decay_t<V>, value_t>) {
+					return _Table().make(
+						F_Hash()(v),
+						[&v](const value_t& t){ return F_Cmp()(t, v); },
+						[&v]() -> V&& { return std::forward<V>(v); }
+					);
+				} else if constexpr (
+					flyweight::detail::is_transparent<F_Hash>{} &&
+					flyweight::detail::is_transparent<F_Cmp>{} &&
+					std::is_invocable_r_v<std::size_t, const F_Hash&, const std::remove_reference_t<V>&> &&
+					std::is_invocable_r_v<bool, const F_Cmp&, const value_t&, const std::remove_reference_t<V>&>
+				) {
+					// value_tを作らずに検索
+					return _Table().make(
+						F_Hash()(v),
+						[&v](const value_t& t){ return F_Cmp()(t, v); },
+						[&v](){ return value_t(std::forward<V>(v)); }
+					);
+				} else
+					return _Make(value_t(std::forward<V>(v)));
+			}
+
+		public:
+			FlyweightId() = default;
+			//! 値(またはvalue_tを構築できる型)を登録して構築
+			/*! 意図しない暗黙の登録を避けるためexplicitにする */
+			template <
+				class V,
+				ENABLE_IF((
+					!std::is_same_v<std::decay_t<V>, FlyweightId> &&
+					std::is_constructible_v<value_t, V>
+				))
+			>
+			explicit FlyweightId(V&& v):
+				_h{_Make(std::forward<V>(v))}
+			{}
+			//! テーブル上のID
+			id_t id() const noexcept {
+				return _h.id;
+			}
+			const value_t& cref() const noexcept {
+				D_Assert0(_h.id != InvalidId);
+				return _Table().get(_h.id);
+			}
+			operator const value_t& () const noexcept {
+				return cref();
+			}
+			const value_t& operator * () const noexcept {
+				return cref();
+			}
+			const value_t* operator -> () const noexcept {
+				return &cref();
+			}
+			const value_t* get() const noexcept {
+				return _h.id == InvalidId ? nullptr : &cref();
+			}
+			explicit operator bool () const noexcept {
+				return _h.id != InvalidId;
+			}
+			bool operator == (const FlyweightId& f) const noexcept {
+				return _h.id == f._h.id;
+			}
+			bool operator != (const FlyweightId& f) const noexcept {
+				return _h.id != f._h.id;
+			}
+			//! テーブルに登録されている値の数
+			static std::size_t NumValue() {
+				return _Table().size();
+			}
+	};
+}
+namespace std {
+	template <class T, class F_Hash, class F_Cmp, bool RC, class Policy>
+	struct hash<spi::FlyweightId<T, F_Hash, F_Cmp, RC, Policy>> {
+		std::size_t operator()(const spi::FlyweightId<T,F_Hash,F_Cmp,RC,Policy>& f) const noexcept {
+			return f.id();
+		}
+	};
+}
@@ -1,45 +1,66 @@
 #pragma once
 #include "flyweight.hpp"
+#include "optional.hpp"
 
 namespace spi {
-	template <class T, class F_Hash=std::hash<T>, class F_Cmp=std::equal_to<>>
+	//! 値をFlyweightで共有するハンドル
+	/*! \tparam Policy	flyweight::Singleなら単一スレッド専用、flyweight::Sharded<N>なら複数スレッドから生成、解放できる */
+	template <class T, class F_Hash=std::hash<T>, class F_Cmp=std::equal_to<>, class Policy=flyweight::Single>
 	class FlyweightItem {
+		public:
+			using value_t = T;
 		private:
-			template <class Ar, class T2, class FH2, class FC2>
-			friend void save(Ar&, const FlyweightItem<T2,FH2,FC2>&);
-			template <class Ar, class T2, class FH2, class FC2>
-			friend void load(Ar&, FlyweightItem<T2,FH2,FC2>&);
+			template <class Ar, class T2, class FH2, class FC2, class P2>
+			friend void save(Ar&, const FlyweightItem<T2,FH2,FC2,P2>&);
+			template <class Ar, class T2, class FH2, class FC2, class P2>
+			friend void load(Ar&, FlyweightItem<T2,FH2,FC2,P2>&);
 
-			using value_t = T;
-			using self_t = FlyweightItem<value_t, F_Hash, F_Cmp>;
+			using self_t = FlyweightItem<value_t, F_Hash, F_Cmp, Policy>;
+			using Set = Flyweight<value_t, F_Hash, F_Cmp, Policy>;
+			using SP = typename Set::SP;
+			using Detached = typename Set::Detached;
+			//! 値の書き換え用(破棄時にテーブルへ登録し直す)
 			struct Temp {
-				self_t*		self;
-				value_t		value;
+				self_t*				self;
+				//! 他に参照が無ければテーブルから外した値を直接書き換える
+				Detached			detached;
+				//! 他と共有している場合は値をコピーして書き換える
+				Optional<value_t>	copy;
 
 				Temp(self_t* self):
 					self(self),
-					value(*self->_sp)
-				{}
+					detached(s_set.detach(self->_sp))
+				{
+					if(!detached) {
+						if constexpr (std::is_copy_constructible_v<value_t>)
+							copy = *self->_sp;
+						else
+							AssertF("shared non-copyable value cannot be modified");
+					}
+				}
 				Temp(const Temp&) = delete;
 				Temp(Temp&& t):
 					self(t.self),
-					value(std::move(t.value))
+					detached(t.detached),
+					copy(std::move(t.copy))
 				{
 					t.self = nullptr;
 				}
 				~Temp() {
-					if(self)
-						self->_sp = s_set.make(std::move(value));
+					if(self) {
+						if(detached)
+							self->_sp = s_set.attach(std::move(self->_sp), detached);
+						else
+							self->_sp = s_set.make(std::move(*copy));
+					}
 				}
 				value_t* operator -> () noexcept {
-					return &value;
+					return &**this;
 				}
 				value_t& operator * () noexcept {
-					return value;
+					return detached ? detached.value() : *copy;
 				}
 			};
-			using Set = Flyweight<value_t, F_Hash, F_Cmp>;
-			using SP = typename Set::SP;
 			static Set		s_set;
 			SP	_sp;
 
@@ -51,12 +72,29 @@ namespace spi {
 			FlyweightItem(value_t&& v):
 				_sp(s_set.make(std::move(v)))
 			{}
+			//! value_t以外の型から構築(ハッシュと比較がis_transparentならvalue_tを作らずに検索する)
+			/*! 意図しない暗黙の登録や比較演算子の曖昧さを避けるためexplicitにする */
+			template <
+				class V,
+				ENABLE_IF((
+					!std::is_same_v<std::decay_t<V>, value_t> &&
+					!std::is_same_v<std::decay_t<V>, self_t> &&
+					std::is_constructible_v<value_t, V>
+				))
+			>
+			explicit FlyweightItem(V&& v):
+				_sp(s_set.make(std::forward<V>(v)))
+			{}
 			const value_t& cref() const noexcept {
 				return static_cast<const value_t&>(*_sp);
 			}
 			static std::size_t GC() {
 				return s_set.gc();
 			}
+			//! 値を共有しているテーブルの統計情報(Flyweight::stats()を参照)
+			static flyweight::Stats Statistics(const bool scan=false) {
+				return s_set.stats(scan);
+			}
 			operator const value_t& () const noexcept {
 				return cref();
 			}
@@ -69,9 +107,21 @@ namespace spi {
 			const value_t* get() const noexcept {
 				return _sp.get();
 			}
+			//! 値を書き換える(戻り値の破棄時に反映)
+			/*!
+				他に同じ値を参照しているアイテムが無ければコピーせずに直接書き換え、再登録する
+				(書き換え中はこのアイテムからも書き換え途中の値が見える)
+				コピーできない型の値を他と共有している場合は例外を送出する
+			*/
 			Temp ref() {
 				return Temp(this);
 			}
+			//! fn(value_t&)でまとめて書き換え、最後に1度だけ再登録する
+			template <class F>
+			void modify(F&& f) {
+				Temp t(this);
+				std::forward<F>(f)(*t);
+			}
 			explicit operator bool () const noexcept {
 				return static_cast<bool>(_sp);
 			}
@@ -90,19 +140,19 @@ namespace spi {
 			DEF_OP(<=)
 			#undef DEF_OP
 	};
-	template <class T, class F_Hash, class F_Cmp>
-	typename FlyweightItem<T, F_Hash, F_Cmp>::Set FlyweightItem<T, F_Hash, F_Cmp>::s_set;
+	template <class T, class F_Hash, class F_Cmp, class Policy>
+	typename FlyweightItem<T, F_Hash, F_Cmp, Policy>::Set FlyweightItem<T, F_Hash, F_Cmp, Policy>::s_set;
 
 	namespace detail {
 		template <class T>
 		struct is_flyweightitem : std::false_type {};
-		template <class T, class FH, class FC>
-		struct is_flyweightitem<FlyweightItem<T,FH,FC>> : std::true_type {};
+		template <class T, class FH, class FC, class P>
+		struct is_flyweightitem<FlyweightItem<T,FH,FC,P>> : std::true_type {};
 	}
 
 	#define DEF_OP(op) \
-		template <class Val, class T, class F_Hash, class F_Cmp, ENABLE_IF(!detail::is_flyweightitem<Val>{})> \
-		bool operator op (const Val& val, const FlyweightItem<T, F_Hash, F_Cmp>& fw) noexcept { \
+		template <class Val, class T, class F_Hash, class F_Cmp, class Policy, ENABLE_IF(!detail::is_flyweightitem<Val>{})> \
+		bool operator op (const Val& val, const FlyweightItem<T, F_Hash, F_Cmp, Policy>& fw) noexcept { \
 			return fw && (fw.cref() op val); \
 		}
 	DEF_OP(==)
@@ -114,9 +164,9 @@ namespace spi {
 	#undef DEF_OP
 }
 namespace std {
-	template <class T, class F_Hash, class F_Cmp>
-	struct hash<spi::FlyweightItem<T, F_Hash, F_Cmp>> {
-		std::size_t operator()(const spi::FlyweightItem<T,F_Hash,F_Cmp>& f) const noexcept {
+	template <class T, class F_Hash, class F_Cmp, class Policy>
+	struct hash<spi::FlyweightItem<T, F_Hash, F_Cmp, Policy>> {
+		std::size_t operator()(const spi::FlyweightItem<T,F_Hash,F_Cmp,Policy>& f) const noexcept {
 			if(f) {
 				auto* r = &f.cref();
 				return std::hash<decltype(r)>()(r);
@@ -1,12 +1,19 @@
 #pragma once
 #include <vector>
+#include <deque>
 #include <cstdint>
 #include <limits>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
 #include "optional.hpp"
 #include "lubee/src/wrapper.hpp"
 #include "enum.hpp"
 
 namespace spi {
+	namespace snapshot {
+		struct Access;
+	}
 	namespace _noseq_list {
 		template <class T>
 		struct RemoveRef {
@@ -119,6 +126,41 @@ namespace spi {
 			template <class Ar, class Id2>
 			friend void serialize(Ar& ar, IDS<Id2>&);
 		};
+		//! フリーリストの先頭からIDを取り出し、密配列の位置objIを指すようにする
+		/*! \param[in] ids	ID -> IDS&を返すファンクタ */
+		template <class Id, class GetIds>
+		Id PopFree(const GetIds& ids, Id& nFree, Id& firstFree, const Id objI) {
+			D_Assert0(nFree > 0);
+			const Id ret = firstFree;
+			auto& idE = ids(ret);
+			D_Assert0(idE.type == IDS<Id>::Type::Free);
+			firstFree = idE.value;		// フリーリストの先頭を書き換え
+			idE = IDS<Id>::AsObjId(objI);
+			--nFree;
+			return ret;
+		}
+		//! IDをフリーリストの先頭につなぐ
+		template <class Id, class GetIds>
+		void PushFree(const GetIds& ids, Id& nFree, Id& firstFree, const Id id) {
+			ids(id) = IDS<Id>::AsFreeId(firstFree);
+			firstFree = id;
+			++nFree;
+		}
+		//! 削除処理(proc)の最中に呼ばれた削除は記録だけしておき、処理を終えてから順に行う
+		template <class Id, class RemList, class Proc>
+		void DeferredRem(bool& bRemoving, RemList& remList, const Id id, const Proc& proc) {
+			if(!bRemoving) {
+				bRemoving = true;
+				proc(id);
+				bRemoving = false;
+				while(!remList.empty()) {
+					const Id tmp = remList[0];
+					remList.erase(remList.begin());
+					DeferredRem(bRemoving, remList, tmp, proc);
+				}
+			} else
+				remList.push_back(id);
+		}
 		template <class Value, class Id>
 		struct Entry {
 			using id_t = Id;
@@ -142,6 +184,30 @@ namespace spi {
 			template <class Ar, class V, class Id2>
 			friend void serialize(Ar& ar, Entry<V,Id2>&);
 		};
+		//! 変更のあったIDの状態(ids.typeがObjなら追加or変更, Freeなら削除)
+		template <class Value, class Id>
+		struct DeltaRecord {
+			using id_t = Id;
+			id_t					id;
+			IDS<Id>					ids;
+			spi::Optional<Value>	value;
+
+			template <class Ar, class V, class Id2>
+			friend void serialize(Ar& ar, DeltaRecord<V,Id2>&);
+		};
+		//! 前回の差分取得時からの変更点
+		template <class Value, class Id>
+		struct Delta {
+			using id_t = Id;
+			using RecordV = std::vector<DeltaRecord<Value, Id>>;
+			id_t		nId = 0,		//!< ID表の長さ
+						nFree = 0,
+						firstFree = 0;
+			RecordV		record;
+
+			template <class Ar, class V, class Id2>
+			friend void serialize(Ar& ar, Delta<V,Id2>&);
+		};
 	}
 
 	//! 順序なしのID付きリスト
@@ -155,6 +221,7 @@ namespace spi {
 		public:
 			using id_t = IDType;
 			using value_t = T;
+			using delta_t = _noseq_list::Delta<value_t, id_t>;
 		private:
 			using this_t = noseq_list<T,Allocator,IDType>;
 			using entry_t = _noseq_list::Entry<value_t, id_t>;
@@ -169,9 +236,30 @@ namespace spi {
 			using RemList = std::vector<id_t>;
 			//! 削除中フラグが立っている時に削除予定のオブジェクトを記録しておく配列
 			RemList		_remList;
+			//! 変更追跡を行っているか
+			bool		_bTrack = false;
+			//! 前回の差分取得時から変更のあったID
+			std::vector<bool>	_dirty;
+			std::vector<id_t>	_dirtyList;
+
+			//! ID -> IDS&の参照用ファンクタ
+			auto _idsAt() noexcept {
+				return [this](const id_t id) -> ids_t& { return _array[id].ids; };
+			}
+			void _markDirty(const id_t id) {
+				if(_bTrack) {
+					if(_dirty.size() <= id)
+						_dirty.resize(id+1);
+					if(!_dirty[id]) {
+						_dirty[id] = true;
+						_dirtyList.push_back(id);
+					}
+				}
+			}
 
 			template <class Ar, class T2, class Alc, class Id>
 			friend void serialize(Ar&, noseq_list<T2,Alc,Id>&);
+			friend struct snapshot::Access;
 
 		public:
 			noseq_list() noexcept {
@@ -181,9 +269,13 @@ namespace spi {
 			noseq_list(noseq_list&& sl) noexcept:
 				_array(std::move(sl._array)),
 				_nFree(sl._nFree),
-				_firstFree(sl._firstFree)
+				_firstFree(sl._firstFree),
+				_bTrack(sl._bTrack),
+				_dirty(std::move(sl._dirty)),
+				_dirtyList(std::move(sl._dirtyList))
 			{
 				sl.clear();
+				sl.setTracking(false);
 			}
 			noseq_list& operator = (noseq_list&& ns) noexcept {
 				this->~noseq_list();
@@ -200,62 +292,50 @@ namespace spi {
 					// 空きが無いので配列の拡張
 					const id_t sz = _array.size();
 					_array.emplace_back(std::forward<T2>(t), sz);
+					_markDirty(sz);
 					return sz;
 				}
-				const id_t ret = _firstFree;					// IDPairを書き込む場所
 				const id_t objI = _array.size() - _nFree;		// ユーザーデータを書き込む場所
-				--_nFree;
+				const id_t ret = _noseq_list::PopFree(_idsAt(), _nFree, _firstFree, objI);
 				auto& objE = _array[objI].udata;
 				objE.value = std::forward<T2>(t);		// ユーザーデータの書き込み
 				objE.uid = ret;
-
-				auto& idE = _array[ret].ids;
-				D_Assert0(idE.type == ids_t::Type::Free);
-				_firstFree = idE.value;		// フリーリストの先頭を書き換え
-				idE = ids_t::AsObjId(objI);	// IDPairの初期化
+				_markDirty(ret);
 				return ret;
 			}
 			void rem(const id_t uindex) {
-				D_Assert(has(uindex), "invalid resource number %1%", uindex);
-				if(!_bRemoving) {
-					_bRemoving = true;
-
-					auto& ids = _array[uindex].ids;
+				_noseq_list::DeferredRem(_bRemoving, _remList, uindex, [this](const id_t uindex){
+					D_Assert(has(uindex), "invalid resource number %1%", uindex);
 					// 削除対象のnoseqインデックスを受け取る
-					D_Assert0(ids.type == ids_t::Type::Obj);
-					const id_t objI = ids.value;
+					const id_t objI = _array[uindex].ids.value;
 					const id_t backI = _array.size()-_nFree-1;
 					if(objI != backI) {
 						// 最後尾と削除予定の要素を交換
 						std::swap(_array[backI].udata, _array[objI].udata);
 						// UIDとindex対応の書き換え
-						_array[_array[objI].udata.uid].ids = ids_t::AsObjId(objI);
+						const id_t uid = _array[objI].udata.uid;
+						_array[uid].ids = ids_t::AsObjId(objI);
+						_markDirty(uid);
 					}
+					_markDirty(uindex);
 					// 要素を解放
 					_array[backI].udata.value = none;
 					// フリーリストをつなぎ替える
-					ids = ids_t::AsFreeId(_firstFree);
-					_firstFree = uindex;
-					++_nFree;
-
-					_bRemoving = false;
-					while(!_remList.empty()) {
-						const id_t tmp = _remList[0];
-						_remList.erase(_remList.begin());
-						rem(tmp);
-					}
-				} else
-					_remList.push_back(uindex);
+					_noseq_list::PushFree(_idsAt(), _nFree, _firstFree, uindex);
+				});
 			}
 			value_t& get(const id_t uindex) {
 				D_Assert(has(uindex), "invalid resource number %1%", uindex);
 				auto& ar = _array[uindex];
 				D_Assert0(ar.ids.type == ids_t::Type::Obj);
 				const id_t idx = ar.ids.value;
+				// 変更追跡中は値が書き換えられるものとして扱う
+				_markDirty(uindex);
 				return *_array[idx].udata.value;
 			}
 			const value_t& get(const id_t uindex) const {
-				return const_cast<noseq_list*>(this)->get(uindex);
+				D_Assert(has(uindex), "invalid resource number %1%", uindex);
+				return *_array[_array[uindex].ids.value].udata.value;
 			}
 			//! IDが有効か判定
 			bool has(const id_t uindex) const {
@@ -312,6 +392,113 @@ namespace spi {
 			bool empty() const {
 				return size() == 0;
 			}
+			//! 密配列の要素を並べ替える(IDは維持される)
+			/*!
+				\param[in] perm	新しい位置iに移動する要素の、現在の位置(begin()からのオフセット)
+				perm[i]はサイズがsize()の0〜size()-1の順列である事
+			*/
+			template <class Perm>
+			void reorder(const Perm& perm) {
+				D_Assert0(!_bRemoving && _remList.empty());
+				const std::size_t n = size();
+				D_Assert0(std::size(perm) == n);
+				using udata_t = _noseq_list::UData<value_t>;
+				std::vector<udata_t> tmp;
+				tmp.reserve(n);
+				for(std::size_t i=0 ; i<n ; i++) {
+					D_Assert0(std::size_t(perm[i]) < n);
+					tmp.emplace_back(std::move(_array[perm[i]].udata));
+				}
+				for(std::size_t i=0 ; i<n ; i++) {
+					auto& ud = _array[i].udata;
+					ud = std::move(tmp[i]);
+					// UIDとindex対応の書き換え
+					_array[ud.uid].ids = ids_t::AsObjId(i);
+					_markDirty(ud.uid);
+				}
+			}
+			//! 密配列の要素を比較関数に従ってソートする(IDは維持される)
+			/*! 材質や空間的なキーで並べておくと、走査時のアクセスがまとまる */
+			template <class Pred=std::less<>>
+			void sortDense(Pred pred=Pred()) {
+				std::vector<id_t> perm(size());
+				for(std::size_t i=0 ; i<perm.size() ; i++)
+					perm[i] = i;
+				std::sort(perm.begin(), perm.end(), [this, &pred](const id_t i0, const id_t i1){
+					return pred(*_array[i0].udata.value, *_array[i1].udata.value);
+				});
+				reorder(perm);
+			}
+			//! 変更追跡の有効/無効を切り替える(変更履歴はクリアされる)
+			/*!
+				追跡中は追加、削除、非const版get()で触れたIDを記録する
+				イテレータ経由で値を書き換えた場合はmarkDirty()を呼ぶこと
+			*/
+			void setTracking(const bool b) {
+				_bTrack = b;
+				clearDirty();
+			}
+			bool tracking() const noexcept {
+				return _bTrack;
+			}
+			//! 値を書き換えたIDを記録
+			void markDirty(const id_t uindex) {
+				D_Assert(has(uindex), "invalid resource number %1%", uindex);
+				_markDirty(uindex);
+			}
+			void clearDirty() {
+				_dirty.clear();
+				_dirtyList.clear();
+			}
+			//! 前回の差分取得時から変更があったか
+			bool hasChange() const noexcept {
+				return !_dirtyList.empty();
+			}
+			//! 前回の差分取得時からの変更点を取り出す(変更履歴はクリアされる)
+			delta_t makeDelta() {
+				D_Assert0(_bTrack);
+				D_Assert0(!_bRemoving && _remList.empty());
+				delta_t ret;
+				ret.nId = _array.size();
+				ret.nFree = _nFree;
+				ret.firstFree = (_nFree > 0) ? _firstFree : 0;
+				ret.record.reserve(_dirtyList.size());
+				for(const id_t id : _dirtyList) {
+					// clear()等で既に無くなったIDは記録しない
+					if(id >= ret.nId)
+						continue;
+					auto& ids = _array[id].ids;
+					auto& rec = ret.record.emplace_back();
+					rec.id = id;
+					rec.ids = ids;
+					if(ids.type == ids_t::Type::Obj)
+						rec.value = *_array[ids.value].udata.value;
+				}
+				clearDirty();
+				return ret;
+			}
+			//! makeDelta()で取り出した変更点を反映
+			/*! 差分を取得した時点の内容と同じ状態のリストに対して適用する */
+			void applyDelta(delta_t delta) {
+				D_Assert0(!_bRemoving && _remList.empty());
+				const id_t prevSize = size();
+				_array.resize(delta.nId);
+				for(auto& rec : delta.record) {
+					D_Assert0(rec.id < delta.nId);
+					_array[rec.id].ids = rec.ids;
+					if(rec.ids.type == ids_t::Type::Obj) {
+						auto& ud = _array[rec.ids.value].udata;
+						ud.value = std::move(rec.value);
+						ud.uid = rec.id;
+					}
+					_markDirty(rec.id);
+				}
+				_nFree = delta.nFree;
+				_firstFree = delta.firstFree;
+				// 削除によって範囲外となった要素を解放
+				for(id_t i=size() ; i<prevSize && i<delta.nId ; i++)
+					_array[i].udata.value = none;
+			}
 			//! 主にデバッグ用。内部状態も含めて比較
 			bool operator == (const noseq_list& lst) const {
 				D_Assert0(!_bRemoving);
@@ -326,5 +513,121 @@ namespace spi {
 			bool operator != (const noseq_list& lst) const {
 				return !(this->operator == (lst));
 			}
+
+			//! 複数スレッドからの要素追加を一時的に溜めておき、commit()でまとめて反映する
+			/*!
+				IDは配列末尾以降をブロック単位で予約して即座に返す
+				Staging作成からcommitまでの間、元のリストに対するadd/emplaceは禁止(remは可)
+				使われなかった予約IDはcommit時にフリーリストへ回される
+			*/
+			class Staging {
+				public:
+					//! スレッド毎に1つ持つ追加バッファ
+					class Buffer {
+						private:
+							friend class Staging;
+							using Data = std::vector<std::pair<id_t, value_t>>;
+							Staging*	_staging;
+							id_t		_cur = 0,
+										_end = 0;
+							Data		_data;
+
+						public:
+							Buffer(Staging* st):
+								_staging(st)
+							{}
+							template <class... Ts>
+							id_t emplace(Ts&&... ts) {
+								return add(value_t(std::forward<Ts>(ts)...));
+							}
+							template <class T2>
+							id_t add(T2&& t) {
+								if(_cur == _end) {
+									// 予約済みIDを使い切ったので次のブロックを確保
+									_cur = _staging->_reserve();
+									_end = _cur + _staging->_blockSize;
+								}
+								const id_t ret = _cur++;
+								_data.emplace_back(ret, std::forward<T2>(t));
+								return ret;
+							}
+							std::size_t size() const noexcept {
+								return _data.size();
+							}
+					};
+				private:
+					using BufferL = std::deque<Buffer>;
+					this_t&				_list;
+					const id_t			_blockSize;
+					id_t				_base;
+					std::atomic<id_t>	_cursor;
+					std::mutex			_mutex;
+					BufferL				_buffer;
+
+					id_t _reserve() noexcept {
+						return _base + _cursor.fetch_add(_blockSize);
+					}
+				public:
+					Staging(this_t& list, const id_t blockSize):
+						_list(list),
+						_blockSize(blockSize),
+						_base(list._array.size()),
+						_cursor(0)
+					{
+						D_Assert0(blockSize > 0);
+					}
+					Staging(const Staging&) = delete;
+					//! 追加用バッファを作成(スレッドセーフ)
+					Buffer& makeBuffer() {
+						std::lock_guard lk(_mutex);
+						return _buffer.emplace_back(this);
+					}
+					//! 溜めておいた要素をリストに一括反映(他のスレッドがBufferを操作していない時に呼ぶ)
+					void commit() {
+						auto& ar = _list._array;
+						D_Assert(ar.size() == _base, "noseq_list was extended while staging");
+						const id_t nRsv = _cursor.load();
+						if(nRsv == 0)
+							return;
+
+						const id_t nDense = _list.size(),
+									nArray = _base + nRsv;
+						ar.resize(nArray);
+						// 密配列の末尾に詰めていく
+						id_t dst = nDense;
+						for(auto& b : _buffer) {
+							for(auto& d : b._data) {
+								auto& objE = ar[dst].udata;
+								objE.value = std::move(d.second);
+								objE.uid = d.first;
+								auto& idE = ar[d.first].ids;
+								D_Assert0(idE.type == ids_t::Type::None);
+								idE = ids_t::AsObjId(dst);
+								_list._markDirty(d.first);
+								++dst;
+							}
+							b._data.clear();
+							b._cur = b._end = 0;
+						}
+						// 使われなかった予約IDをフリーリストへ(若い番号が先頭に来るよう逆順)
+						for(id_t i=nArray ; i-- != _base ; ) {
+							auto& idE = ar[i].ids;
+							if(idE.type == ids_t::Type::None) {
+								idE = ids_t::AsFreeId(_list._firstFree);
+								_list._firstFree = i;
+								_list._markDirty(i);
+							}
+						}
+						_list._nFree = nArray - dst;
+						_base = nArray;
+						_cursor = 0;
+					}
+			};
+			//! 複数スレッドからの追加用オブジェクトを作成
+			/*! \param[in] blockSize	バッファが一度に予約するIDの数 */
+			Staging makeStaging(const id_t blockSize=64) {
+				D_Assert0(!_bRemoving && _remList.empty());
+				return Staging(*this, blockSize);
+			}
 	};
 }
@@ -0,0 +1,209 @@
+#pragma once
+#include "noseq_list.hpp"
+#include <tuple>
+#include <algorithm>
+
+namespace spi {
+	//! 複数の列(コンポーネント)が1つのID空間を共有する順序なしテーブル
+	/*!
+		noseq_listと同じく削除時は最後尾と交換し、空いたIDはフリーリストで再利用する
+		値は列毎に連続した配列(SoA)で保持するので、必要な列だけをまとめて走査できる
+		\tparam Allocator	列やID表の確保に使うアロケータ(要素型はrebindされる)
+		\tparam IDType		IDの型
+	*/
+	template <class Allocator, class IDType, class... Cols>
+	class basic_noseq_table {
+		public:
+			using id_t = IDType;
+			using allocator_t = Allocator;
+			using row_t = std::tuple<Cols...>;
+			constexpr static std::size_t NColumn = sizeof...(Cols);
+			template <std::size_t I>
+			using column_t = std::tuple_element_t<I, row_t>;
+		private:
+			using this_t = basic_noseq_table<Allocator, IDType, Cols...>;
+			using ids_t = _noseq_list::IDS<id_t>;
+			template <class T2>
+			using Vec = std::vector<T2, typename std::allocator_traits<Allocator>::template rebind_alloc<T2>>;
+			using Column = std::tuple<Vec<Cols>...>;
+			using IdsV = Vec<ids_t>;
+			using UidV = Vec<id_t>;
+			using Seq = std::index_sequence_for<Cols...>;
+
+			Column		_column;		//!< 列毎の密配列
+			UidV		_uid;			//!< 密配列のインデックス -> ID
+			IdsV		_ids;			//!< ID -> 密配列のインデックス or 次の空きID
+			id_t		_nFree = 0,		//!< 空きID数
+						_firstFree;		//!< 最初の空きID
+			//! 現在削除処理中かのフラグ
+			bool		_bRemoving = false;
+			using RemList = Vec<id_t>;
+			//! 削除中フラグが立っている時に削除予定のIDを記録しておく配列
+			RemList		_remList;
+
+			//! 1要素追加しても再確保が起きないよう、容量を倍々で確保しておく
+			template <class V>
+			static void _ReserveNext(V& v) {
+				if(v.size() == v.capacity())
+					v.reserve(std::max<std::size_t>(v.size()*2, 4));
+			}
+			template <std::size_t... Idx>
+			void _reserveNext(std::index_sequence<Idx...>) {
+				(_ReserveNext(std::get<Idx>(_column)), ...);
+			}
+			//! 列I以降に値を追加(途中で例外が出たら追加済みの列を戻す)
+			/*! 容量は確保済みなので、例外を投げ得るのは要素の構築のみ */
+			template <std::size_t I, class T0, class... Ts>
+			void _pushBack(T0&& t0, Ts&&... ts) {
+				auto& c = std::get<I>(_column);
+				c.emplace_back(std::forward<T0>(t0));
+				if constexpr (sizeof...(Ts) > 0) {
+					try {
+						_pushBack<I+1>(std::forward<Ts>(ts)...);
+					} catch(...) {
+						c.pop_back();
+						throw;
+					}
+				}
+			}
+			template <std::size_t... Idx>
+			void _moveFromBack(std::index_sequence<Idx...>, const id_t objI) {
+				(_moveFromBack(std::get<Idx>(_column), objI), ...);
+			}
+			template <class V>
+			static void _moveFromBack(V& v, const id_t objI) {
+				v[objI] = std::move(v.back());
+			}
+			template <std::size_t... Idx>
+			void _popBack(std::index_sequence<Idx...>) {
+				(std::get<Idx>(_column).pop_back(), ...);
+			}
+			template <std::size_t... Idx>
+			void _clear(std::index_sequence<Idx...>) {
+				(std::get<Idx>(_column).clear(), ...);
+			}
+			template <std::size_t... Idx>
+			void _reserve(std::index_sequence<Idx...>, const std::size_t n) {
+				(std::get<Idx>(_column).reserve(n), ...);
+			}
+			template <std::size_t... Idx>
+			auto _getRow(std::index_sequence<Idx...>, const id_t objI) {
+				return std::forward_as_tuple(std::get<Idx>(_column)[objI]...);
+			}
+			template <std::size_t... Idx>
+			auto _getRow(std::index_sequence<Idx...>, const id_t objI) const {
+				return std::forward_as_tuple(std::get<Idx>(_column)[objI]...);
+			}
+			//! ID -> IDS&の参照用ファンクタ
+			auto _idsAt() noexcept {
+				return [this](const id_t id) -> ids_t& { return _ids[id]; };
+			}
+			id_t _index(const id_t uindex) const {
+				D_Assert(has(uindex), "invalid resource number %1%", uindex);
+				return _ids[uindex].value;
+			}
+
+		public:
+			//! 1行追加
+			/*!
+				\return 追加した行のID
+				列の構築で例外が発生した場合はテーブルを変更しない
+			*/
+			template <class... Ts>
+			id_t add(Ts&&... ts) {
+				static_assert(sizeof...(Ts) == NColumn, "number of arguments should be same as columns");
+				const id_t objI = size();
+				// 先に全ての配列の容量を確保し、以降は列の構築以外で例外が出ないようにする
+				_reserveNext(Seq{});
+				_ReserveNext(_uid);
+				if(_nFree == 0)
+					_ReserveNext(_ids);
+				if constexpr (NColumn > 0)
+					_pushBack<0>(std::forward<Ts>(ts)...);
+				id_t ret;
+				if(_nFree == 0) {
+					// 空きが無いのでID配列の拡張
+					ret = _ids.size();
+					_ids.emplace_back(ids_t::AsObjId(objI));
+				} else
+					ret = _noseq_list::PopFree(_idsAt(), _nFree, _firstFree, objI);
+				_uid.emplace_back(ret);
+				return ret;
+			}
+			void rem(const id_t uindex) {
+				_noseq_list::DeferredRem(_bRemoving, _remList, uindex, [this](const id_t uindex){
+					D_Assert(has(uindex), "invalid resource number %1%", uindex);
+					const id_t objI = _ids[uindex].value;
+					const id_t backI = size()-1;
+					if(objI != backI) {
+						// 最後尾の行を削除対象の位置へ移動
+						_moveFromBack(Seq{}, objI);
+						_uid[objI] = _uid[backI];
+						// UIDとindex対応の書き換え
+						_ids[_uid[objI]] = ids_t::AsObjId(objI);
+					}
+					_popBack(Seq{});
+					_uid.pop_back();
+					// フリーリストをつなぎ替える
+					_noseq_list::PushFree(_idsAt(), _nFree, _firstFree, uindex);
+				});
+			}
+			//! IDが有効か判定
+			bool has(const id_t uindex) const {
+				if(_ids.size() <= uindex || _ids[uindex].type != ids_t::Type::Obj)
+					return false;
+				return true;
+			}
+			//! IDに対応する行の、ある列の値を参照
+			template <std::size_t I>
+			column_t<I>& get(const id_t uindex) {
+				return std::get<I>(_column)[_index(uindex)];
+			}
+			template <std::size_t I>
+			const column_t<I>& get(const id_t uindex) const {
+				return std::get<I>(_column)[_index(uindex)];
+			}
+			//! IDに対応する行の全ての列を参照(tuple of reference)
+			auto getRow(const id_t uindex) {
+				return _getRow(Seq{}, _index(uindex));
+			}
+			auto getRow(const id_t uindex) const {
+				return _getRow(Seq{}, _index(uindex));
+			}
+			//! 列の先頭ポインタ(要素数はsize())
+			/*! 行の順序は全ての列で共通 */
+			template <std::size_t I>
+			column_t<I>* column() noexcept {
+				return std::get<I>(_column).data();
+			}
+			template <std::size_t I>
+			const column_t<I>* column() const noexcept {
+				return std::get<I>(_column).data();
+			}
+			//! 密配列の位置に対応するIDを取得
+			id_t idAt(const std::size_t idx) const {
+				D_Assert0(idx < size());
+				return _uid[idx];
+			}
+			void reserve(const std::size_t n) {
+				_reserve(Seq{}, n);
+				_uid.reserve(n);
+			}
+			std::size_t size() const noexcept {
+				return _uid.size();
+			}
+			bool empty() const noexcept {
+				return size() == 0;
+			}
+			void clear() {
+				D_Assert0(!_bRemoving && _remList.empty());
+				_clear(Seq{});
+				_uid.clear();
+				_ids.clear();
+				_nFree = 0;
+			}
+	};
+	//! 標準アロケータとuint_fast32_tのIDを使うnoseq_table
+	template <class... Cols>
+	using noseq_table = basic_noseq_table<std::allocator<void>, uint_fast32_t, Cols...>;
+}
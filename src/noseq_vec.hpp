@@ -1,5 +1,10 @@
 #pragma once
 #include <vector>
+#include <iterator>
+#include <memory>
+#include <algorithm>
+#include <initializer_list>
+#include <cstdint>
 #include "lubee/src/error.hpp"
 
 namespace spi {
@@ -24,5 +29,325 @@ namespace spi {
 				D_Assert0(itr != base_t::end());
 				base_t::pop_back();
 			}
+			//! 複数の要素をまとめて削除
+			/*!
+				空いた場所は末尾側の要素で埋める(1要素ずつeraseするのと違い、後続のインデックスがずれない)
+				\param[in] first,last	削除する要素のインデックス(昇順、重複なし)
+			*/
+			template <class Itr>
+			void erase_indices(Itr first, Itr last) {
+				// 大きいインデックスから順に、その時点の末尾要素で穴を埋める
+				// (それより後ろの削除対象は処理済みなので、末尾は常に残す要素か自分自身)
+				auto* const data = base_t::data();
+				std::size_t sz = base_t::size();
+				while(last != first) {
+					--last;
+					const std::size_t idx = *last;
+					D_Assert0(idx < sz);
+					D_Assert0(last == first || std::size_t(*std::prev(last)) < idx);
+					if(idx != --sz)
+						data[idx] = std::move(data[sz]);
+				}
+				// 末尾の要素をまとめて破棄
+				base_t::erase(base_t::begin()+sz, base_t::end());
+			}
+			template <class C>
+			void erase_indices(const C& c) {
+				erase_indices(std::begin(c), std::end(c));
+			}
+			//! 条件に合う要素をまとめて削除
+			/*!
+				空いた場所は末尾側の要素で埋める
+				\return 削除した要素数
+			*/
+			template <class Pred>
+			std::size_t erase_if(Pred pred) {
+				auto first = base_t::begin(),
+					last = base_t::end();
+				for(;;) {
+					while(first != last && !pred(*first))
+						++first;
+					if(first == last)
+						break;
+					// 末尾側から残す要素を探す
+					do {
+						--last;
+					} while(first != last && pred(*last));
+					if(first == last)
+						break;
+					*first = std::move(*last);
+					++first;
+				}
+				const std::size_t ret = base_t::end() - first;
+				base_t::erase(first, base_t::end());
+				return ret;
+			}
+	};
+	//! 要素数がN個以下の間はヒープを使わない順序なし配列
+	/*! 要素を削除した時はnoseq_vecと同じく最後尾の要素と取り替える */
+	template <class T, std::size_t N, class AL=std::allocator<T>>
+	class noseq_small_vec {
+		private:
+			static_assert(N > 0, "inline capacity should be greater than 0");
+			using traits_t = std::allocator_traits<AL>;
+			using this_t = noseq_small_vec<T,N,AL>;
+			//! 内部バッファ
+			struct alignas(alignof(T)) Inline {
+				uint8_t	data[sizeof(T) * N];
+			};
+			Inline			_inline;
+			T*				_ptr;
+			std::size_t		_size,
+							_capacity;
+			AL				_alc;
+
+			T* _inlinePtr() noexcept {
+				return reinterpret_cast<T*>(_inline.data);
+			}
+			void _destroyRange(T* p, const std::size_t n) noexcept {
+				for(std::size_t i=0 ; i<n ; i++)
+					traits_t::destroy(_alc, p+i);
+			}
+			//! 確保領域を解放し、内部バッファを指すように戻す
+			void _release() noexcept {
+				_destroyRange(_ptr, _size);
+				if(!isInline())
+					traits_t::deallocate(_alc, _ptr, _capacity);
+				_ptr = _inlinePtr();
+				_size = 0;
+				_capacity = N;
+			}
+			//! 確保済みの領域p(容量n)へ要素を移し、元の領域を解放する
+			/*!
+				要素の移動中に例外が投げられた場合はpを破棄し、元の領域をそのまま残す
+				(要素がnoexceptでムーブできない場合はコピーするので、元の要素も変化しない)
+				\param[in] nTail	p[_size]以降に構築済みの要素数(失敗時はこれも破棄する)
+			*/
+			void _relocate(T *const p, const std::size_t n, const std::size_t nTail) {
+				std::size_t i = 0;
+				try {
+					for( ; i<_size ; i++)
+						traits_t::construct(_alc, p+i, std::move_if_noexcept(_ptr[i]));
+				} catch(...) {
+					_destroyRange(p, i);
+					_destroyRange(p+_size, nTail);
+					traits_t::deallocate(_alc, p, n);
+					throw;
+				}
+				_destroyRange(_ptr, _size);
+				if(!isInline())
+					traits_t::deallocate(_alc, _ptr, _capacity);
+				_ptr = p;
+				_capacity = n;
+			}
+			//! 容量をnに広げる
+			void _grow(const std::size_t n) {
+				D_Assert0(n > _capacity);
+				_relocate(traits_t::allocate(_alc, n), n, 0);
+			}
+			//! 中身を移動(空の状態で呼ぶ。移動元は空になる)
+			void _moveFrom(noseq_small_vec& v) {
+				D_Assert0(_size == 0);
+				if(v.isInline() || !(_alc == v._alc)) {
+					// アロケータが異なる場合はヒープ領域を受け取れないので、要素毎に移動する
+					reserve(v._size);
+					for(std::size_t i=0 ; i<v._size ; i++)
+						traits_t::construct(_alc, _ptr+i, std::move(v._ptr[i]));
+					_size = v._size;
+					v.clear();
+				} else {
+					// ヒープ領域はポインタごと受け取る
+					_ptr = v._ptr;
+					_size = v._size;
+					_capacity = v._capacity;
+					v._ptr = v._inlinePtr();
+					v._size = 0;
+					v._capacity = N;
+				}
+			}
+
+		public:
+			using value_type = T;
+			using iterator = T*;
+			using const_iterator = const T*;
+
+			noseq_small_vec() noexcept(noexcept(AL())):
+				noseq_small_vec(AL())
+			{}
+			explicit noseq_small_vec(const AL& alc) noexcept:
+				_ptr(_inlinePtr()),
+				_size(0),
+				_capacity(N),
+				_alc(alc)
+			{}
+			noseq_small_vec(std::initializer_list<T> il):
+				noseq_small_vec()
+			{
+				reserve(il.size());
+				for(auto& v : il)
+					emplace_back(v);
+			}
+			noseq_small_vec(const noseq_small_vec& v):
+				noseq_small_vec(traits_t::select_on_container_copy_construction(v._alc))
+			{
+				reserve(v._size);
+				for(auto& e : v)
+					emplace_back(e);
+			}
+			noseq_small_vec(noseq_small_vec&& v) noexcept(std::is_nothrow_move_constructible_v<T>):
+				noseq_small_vec(std::move(v._alc))
+			{
+				_moveFrom(v);
+			}
+			~noseq_small_vec() {
+				_release();
+			}
+			noseq_small_vec& operator = (const noseq_small_vec& v) {
+				if(this != &v) {
+					clear();
+					reserve(v._size);
+					for(auto& e : v)
+						emplace_back(e);
+				}
+				return *this;
+			}
+			//! アロケータを受け取るか等しければ、ヒープ領域はポインタごと受け取る
+			noseq_small_vec& operator = (noseq_small_vec&& v) noexcept(
+				std::is_nothrow_move_constructible_v<T> &&
+				(traits_t::propagate_on_container_move_assignment::value || traits_t::is_always_equal::value)
+			) {
+				if(this != &v) {
+					_release();
+					if constexpr (traits_t::propagate_on_container_move_assignment::value)
+						_alc = std::move(v._alc);
+					_moveFrom(v);
+				}
+				return *this;
+			}
+
+			template <class... Ts>
+			T& emplace_back(Ts&&... ts) {
+				if(_size == _capacity) {
+					// 引数が自身の要素を参照していても良いよう、移動より先に新しい領域へ追加する要素を構築する
+					const std::size_t n = _capacity * 2;
+					T *const p = traits_t::allocate(_alc, n);
+					try {
+						traits_t::construct(_alc, p+_size, std::forward<Ts>(ts)...);
+					} catch(...) {
+						traits_t::deallocate(_alc, p, n);
+						throw;
+					}
+					_relocate(p, n, 1);
+				} else
+					traits_t::construct(_alc, _ptr+_size, std::forward<Ts>(ts)...);
+				return _ptr[_size++];
+			}
+			void push_back(const T& t) {
+				emplace_back(t);
+			}
+			void push_back(T&& t) {
+				emplace_back(std::move(t));
+			}
+			void pop_back() noexcept {
+				D_Assert0(_size > 0);
+				traits_t::destroy(_alc, _ptr + --_size);
+			}
+			void erase(const iterator itr) {
+				D_Assert0(begin() <= itr && itr < end());
+				if(itr != end()-1) {
+					// 削除対象が最後尾でなければ最後尾の要素を移動してくる
+					*itr = std::move(back());
+				}
+				pop_back();
+			}
+			//! 複数の要素をまとめて削除(noseq_vec::erase_indicesと同じ)
+			template <class Itr>
+			void erase_indices(Itr first, Itr last) {
+				while(last != first) {
+					--last;
+					const std::size_t idx = *last;
+					D_Assert0(idx < _size);
+					D_Assert0(last == first || std::size_t(*std::prev(last)) < idx);
+					if(idx != _size-1)
+						_ptr[idx] = std::move(back());
+					pop_back();
+				}
+			}
+			template <class C>
+			void erase_indices(const C& c) {
+				erase_indices(std::begin(c), std::end(c));
+			}
+			//! 条件に合う要素をまとめて削除(noseq_vec::erase_ifと同じ)
+			template <class Pred>
+			std::size_t erase_if(Pred pred) {
+				auto first = begin(),
+					last = end();
+				for(;;) {
+					while(first != last && !pred(*first))
+						++first;
+					if(first == last)
+						break;
+					do {
+						--last;
+					} while(first != last && pred(*last));
+					if(first == last)
+						break;
+					*first = std::move(*last);
+					++first;
+				}
+				const std::size_t ret = end() - first;
+				while(end() != first)
+					pop_back();
+				return ret;
+			}
+			void reserve(const std::size_t n) {
+				if(n > _capacity)
+					_grow(n);
+			}
+			void resize(const std::size_t n) {
+				reserve(n);
+				while(_size > n)
+					pop_back();
+				while(_size < n)
+					emplace_back();
+			}
+			void clear() noexcept {
+				_destroyRange(_ptr, _size);
+				_size = 0;
+			}
+			//! 要素が内部バッファに収まっているか
+			bool isInline() const noexcept {
+				return _ptr == reinterpret_cast<const T*>(_inline.data);
+			}
+			std::size_t size() const noexcept { return _size; }
+			std::size_t capacity() const noexcept { return _capacity; }
+			bool empty() const noexcept { return _size == 0; }
+			T* data() noexcept { return _ptr; }
+			const T* data() const noexcept { return _ptr; }
+			iterator begin() noexcept { return _ptr; }
+			iterator end() noexcept { return _ptr + _size; }
+			const_iterator begin() const noexcept { return _ptr; }
+			const_iterator end() const noexcept { return _ptr + _size; }
+			const_iterator cbegin() const noexcept { return _ptr; }
+			const_iterator cend() const noexcept { return _ptr + _size; }
+			T& operator[](const std::size_t n) noexcept {
+				D_Assert0(n < _size);
+				return _ptr[n];
+			}
+			const T& operator[](const std::size_t n) const noexcept {
+				D_Assert0(n < _size);
+				return _ptr[n];
+			}
+			T& front() noexcept { return (*this)[0]; }
+			const T& front() const noexcept { return (*this)[0]; }
+			T& back() noexcept { return (*this)[_size-1]; }
+			const T& back() const noexcept { return (*this)[_size-1]; }
+
+			bool operator == (const noseq_small_vec& v) const {
+				return std::equal(begin(), end(), v.begin(), v.end());
+			}
+			bool operator != (const noseq_small_vec& v) const {
+				return !(this->operator == (v));
+			}
 	};
 }
@@ -2,22 +2,34 @@
 #include "optional.hpp"
 #include <deque>
 #include <algorithm>
+#include <vector>
+#include <iterator>
+#include <cstdint>
 
 namespace spi {
 	namespace test {
 		class PQueueTest;
 	}
+	//! 同じ優先度の要素は後から追加した方を後ろに置く
 	struct InsertAfter {
 		template <class T, class Pred>
 		bool operator()(const T& t0, const T& t1, Pred p) const {
 			return p(t0, t1);
 		}
+		//! 追加順の通し番号で前後を決める場合に使用(s0が先に来るならtrue)
+		static bool SeqFirst(const uint64_t s0, const uint64_t s1) noexcept {
+			return s0 < s1;
+		}
 	};
+	//! 同じ優先度の要素は後から追加した方を前に置く
 	struct InsertBefore {
 		template <class T, class Pred>
 		bool operator()(const T& t0, const T& t1, Pred p) const {
 			return !p(t1, t0);
 		}
+		static bool SeqFirst(const uint64_t s0, const uint64_t s1) noexcept {
+			return s0 > s1;
+		}
 	};
 	//! 優先度付きキュー
 	template <class T, template<class,class> class Container=std::deque, class Pred=std::less<T>, class Insert=InsertAfter>
@@ -59,6 +71,35 @@ namespace spi {
 			void push(TA&& t) {
 				_push(std::forward<TA>(t), typename std::iterator_traits<typename base_type::iterator>::iterator_category());
 			}
+			//! 複数の要素をまとめて追加
+			/*!
+				1つずつpushしたのと同じ並び順になる
+				追加分をソートしてから既存の列とマージするので、O(n + k log k)
+			*/
+			template <class Itr>
+			void push_range(Itr first, Itr last) {
+				using Vec = std::vector<T>;
+				Vec tmp(first, last);
+				if(tmp.empty())
+					return;
+				Pred pred;
+				// 後から追加した物を前に置く場合は、安定ソートの前に順序を反転しておく
+				if(Insert::SeqFirst(1, 0))
+					std::reverse(tmp.begin(), tmp.end());
+				std::stable_sort(tmp.begin(), tmp.end(), pred);
+				const std::size_t n = base_type::size(),
+								k = tmp.size();
+				const auto mvB = std::make_move_iterator(tmp.begin()),
+							mvE = std::make_move_iterator(tmp.end());
+				// inplace_mergeは安定なので、同じ優先度の要素は前半の列の物が前に来る
+				if(Insert::SeqFirst(0, 1)) {
+					base_type::insert(base_type::end(), mvB, mvE);
+					std::inplace_merge(base_type::begin(), std::next(base_type::begin(), n), base_type::end(), pred);
+				} else {
+					base_type::insert(base_type::begin(), mvB, mvE);
+					std::inplace_merge(base_type::begin(), std::next(base_type::begin(), k), base_type::end(), pred);
+				}
+			}
 			// 優先順位が変わってしまうかもしれないので参照はconstのみとする
 			const T& back() const {
 				return base_type::back();
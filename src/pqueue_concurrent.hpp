@@ -0,0 +1,163 @@
+#pragma once
+#include "pqueue_heap.hpp"
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace spi {
+	//! 複数スレッドから同時にpush/popできる緩和優先度付きキュー(MultiQueue)
+	/*!
+		内部にc*p個(p: スレッド数, c: queuePerThread)の独立したヒープを持ち、それぞれを個別のロックで保護する
+		pushはランダムに選んだヒープへ、popはランダムに選んだ2つのヒープの先頭を比べて優先度の高い方から取り出す
+		取り出し順は厳密ではなく、取り出される要素の順位(全体で何番目に優先度が高いか)の期待値はO(c*p)に収まる
+		(Rihani, Sanders, Dementiev "MultiQueues: Simpler, Faster, and Better Relaxed Concurrent Priority Queues")
+		同じ優先度の要素の順序は個々のヒープ内でのみInsertの指定に従う
+	*/
+	template <class T, class Pred=std::less<T>, class Insert=InsertAfter, std::size_t D=4>
+	class pqueue_concurrent {
+		private:
+			using Heap = pqueue_heap<T, Pred, Insert, D>;
+			// 隣のヒープとキャッシュラインを共有しないようにする
+			struct alignas(64) Sub {
+				std::mutex					mutex;
+				Heap						heap;
+				//! ロックを取らずに空判定をする為の要素数
+				std::atomic<std::size_t>	size{0};
+			};
+			using SubA = std::unique_ptr<Sub[]>;
+			SubA			_sub;
+			std::size_t		_nSub;
+			Pred			_pred;
+
+			//! スレッド毎の乱数(xorshift)
+			static uint64_t _random() noexcept {
+				thread_local uint64_t s = reinterpret_cast<uintptr_t>(&s) | 1;
+				s ^= s << 13;
+				s ^= s >> 7;
+				s ^= s << 17;
+				return s;
+			}
+			std::size_t _randomIndex() const noexcept {
+				return _random() % _nSub;
+			}
+			//! ロック済みのサブキューから先頭を取り出す
+			static void _popLocked(Sub& s, T& dst) {
+				s.heap.pop_front(dst);
+				s.size.store(s.heap.size(), std::memory_order_relaxed);
+			}
+			//! 全てのサブキューを順に調べて取り出す(ランダムな選択で見つからなかった時用)
+			bool _popScan(T& dst) {
+				const std::size_t ofs = _randomIndex();
+				for(std::size_t i=0 ; i<_nSub ; i++) {
+					auto& s = _sub[(ofs + i) % _nSub];
+					if(s.size.load(std::memory_order_relaxed) == 0)
+						continue;
+					std::lock_guard lk(s.mutex);
+					if(!s.heap.empty()) {
+						_popLocked(s, dst);
+						return true;
+					}
+				}
+				return false;
+			}
+
+		public:
+			//! \param[in] nThread			アクセスするスレッド数(0ならハードウェアのスレッド数)
+			//! \param[in] queuePerThread	スレッドあたりのヒープ数(大きい程競合が減り、取り出し順の誤差が増える)
+			pqueue_concurrent(
+				std::size_t nThread = 0,
+				const std::size_t queuePerThread = 2,
+				const Pred& pred = Pred()
+			):
+				_pred(pred)
+			{
+				if(nThread == 0)
+					nThread = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+				D_Assert0(queuePerThread > 0);
+				// 2つ選ぶ為に最低2つは用意する
+				_nSub = std::max<std::size_t>(nThread * queuePerThread, 2);
+				_sub.reset(new Sub[_nSub]);
+				// 状態を持つ比較関数でも全てのヒープで同じ物を使う
+				for(std::size_t i=0 ; i<_nSub ; i++)
+					_sub[i].heap = Heap(pred);
+			}
+			pqueue_concurrent(const pqueue_concurrent&) = delete;
+			pqueue_concurrent& operator = (const pqueue_concurrent&) = delete;
+
+			template <class TA>
+			void push(TA&& t) {
+				// ロックが取れるまでヒープを選び直す
+				for(;;) {
+					auto& s = _sub[_randomIndex()];
+					std::unique_lock lk(s.mutex, std::try_to_lock);
+					if(lk.owns_lock()) {
+						s.heap.push(std::forward<TA>(t));
+						s.size.store(s.heap.size(), std::memory_order_relaxed);
+						return;
+					}
+				}
+			}
+			//! 優先度の高い要素を1つ取り出す
+			/*! \return 要素が無ければfalse */
+			bool pop_front(T& dst) {
+				for(int retry=0 ; retry<4 ; retry++) {
+					std::size_t i0 = _randomIndex(),
+								i1 = _randomIndex();
+					if(i0 == i1)
+						i1 = (i1 + 1) % _nSub;
+					auto *s0 = &_sub[i0],
+						*s1 = &_sub[i1];
+					// 空のキューは選ばない
+					const bool e0 = s0->size.load(std::memory_order_relaxed) == 0,
+								e1 = s1->size.load(std::memory_order_relaxed) == 0;
+					if(e0 && e1)
+						continue;
+					if(e0)
+						std::swap(s0, s1);
+					std::unique_lock lk0(s0->mutex, std::try_to_lock);
+					if(!lk0.owns_lock())
+						continue;
+					if(s0->heap.empty())
+						continue;
+					if(!e0 && !e1) {
+						// 両方の先頭を比べて優先度の高い方から取り出す
+						// (もう片方のロックが取れなければ比較は省略)
+						std::unique_lock lk1(s1->mutex, std::try_to_lock);
+						if(lk1.owns_lock() &&
+							!s1->heap.empty() &&
+							_pred(s1->heap.front(), s0->heap.front()))
+						{
+							_popLocked(*s1, dst);
+							return true;
+						}
+					}
+					_popLocked(*s0, dst);
+					return true;
+				}
+				return _popScan(dst);
+			}
+			//! 要素数(他のスレッドが操作中の場合は近似値)
+			std::size_t size() const noexcept {
+				std::size_t ret = 0;
+				for(std::size_t i=0 ; i<_nSub ; i++)
+					ret += _sub[i].size.load(std::memory_order_relaxed);
+				return ret;
+			}
+			bool empty() const noexcept {
+				return size() == 0;
+			}
+			std::size_t numQueue() const noexcept {
+				return _nSub;
+			}
+			//! 全ての要素を削除(他のスレッドが操作していない時に呼ぶ)
+			void clear() {
+				for(std::size_t i=0 ; i<_nSub ; i++) {
+					auto& s = _sub[i];
+					std::lock_guard lk(s.mutex);
+					s.heap.clear();
+					s.size.store(0, std::memory_order_relaxed);
+				}
+			}
+	};
+}
@@ -0,0 +1,331 @@
+#pragma once
+#include "pqueue.hpp"
+#include "lubee/src/error.hpp"
+#include <vector>
+
+namespace spi {
+	namespace _pqueue_heap {
+		//! d分ヒープの共通処理
+		/*!
+			Derivedは以下を定義する
+			bool _first(const Node&, const Node&) const		(第1引数が先に取り出されるべきならtrue)
+			void _onPlace(std::size_t)						(要素がヒープ内の位置に置かれた時に呼ばれる)
+		*/
+		template <class Derived, class Node, std::size_t D>
+		class HeapBase {
+			static_assert(D >= 2, "heap arity should be greater than 1");
+			protected:
+				using Vec = std::vector<Node>;
+				Vec			_heap;
+
+				Derived& _derived() noexcept {
+					return static_cast<Derived&>(*this);
+				}
+				void _place(const std::size_t idx, Node&& n) {
+					_heap[idx] = std::move(n);
+					_derived()._onPlace(idx);
+				}
+				//! idxにある要素を上に移動
+				/*! \return 移動後の位置 */
+				std::size_t _siftUp(std::size_t idx) {
+					auto& self = _derived();
+					Node tmp = std::move(_heap[idx]);
+					while(idx > 0) {
+						const std::size_t parent = (idx-1) / D;
+						if(!self._first(tmp, _heap[parent]))
+							break;
+						_place(idx, std::move(_heap[parent]));
+						idx = parent;
+					}
+					_place(idx, std::move(tmp));
+					return idx;
+				}
+				//! idxにある要素を下に移動
+				void _siftDown(std::size_t idx) {
+					auto& self = _derived();
+					const std::size_t n = _heap.size();
+					Node tmp = std::move(_heap[idx]);
+					for(;;) {
+						const std::size_t c0 = idx*D + 1;
+						if(c0 >= n)
+							break;
+						// 子の中で最も優先度の高いものを探す
+						const std::size_t c1 = std::min(c0 + D, n);
+						std::size_t best = c0;
+						for(std::size_t c=c0+1 ; c<c1 ; c++) {
+							if(self._first(_heap[c], _heap[best]))
+								best = c;
+						}
+						if(!self._first(_heap[best], tmp))
+							break;
+						_place(idx, std::move(_heap[best]));
+						idx = best;
+					}
+					_place(idx, std::move(tmp));
+				}
+				//! 値が変化した要素を適切な位置へ移動
+				void _fix(const std::size_t idx) {
+					if(_siftUp(idx) == idx)
+						_siftDown(idx);
+				}
+				void _push(Node&& n) {
+					_heap.push_back(std::move(n));
+					_siftUp(_heap.size()-1);
+				}
+				//! 末尾に追加済みのk個の要素をヒープに組み込む
+				void _pushed(const std::size_t k) {
+					const std::size_t n = _heap.size();
+					if(k < n-k) {
+						// 既存の要素が多い場合は1つずつ
+						for(std::size_t i=n-k ; i<n ; i++)
+							_siftUp(i);
+					} else {
+						// 全体を組み直す(O(n))
+						for(std::size_t i=(n-1)/D+1 ; i-- > 0 ;)
+							_siftDown(i);
+					}
+				}
+				//! idxにある要素をヒープから取り除く
+				void _remove(const std::size_t idx) {
+					D_Assert0(idx < _heap.size());
+					const std::size_t last = _heap.size()-1;
+					if(idx != last) {
+						_place(idx, std::move(_heap.back()));
+						_heap.pop_back();
+						_fix(idx);
+					} else
+						_heap.pop_back();
+				}
+
+			public:
+				void reserve(const std::size_t n) {
+					_heap.reserve(n);
+				}
+				bool empty() const noexcept {
+					return _heap.empty();
+				}
+				std::size_t size() const noexcept {
+					return _heap.size();
+				}
+		};
+		template <class T>
+		struct Node {
+			T			value;
+			uint64_t	seq;
+		};
+	}
+	//! d分ヒープによる優先度付きキュー
+	/*!
+		push, pop_frontがO(log n)
+		pqueueと違い全体の並び順は保持しないので、取り出せるのは先頭の要素のみ
+		同じ優先度の要素の順番は追加時の通し番号によりInsertAfter/InsertBeforeと同じになる
+		\tparam D 1ノードあたりの子の数(4程度にすると木が浅くなり、子ノードが同じキャッシュラインに乗りやすい)
+	*/
+	template <class T, class Pred=std::less<T>, class Insert=InsertAfter, std::size_t D=4>
+	class pqueue_heap :
+		public _pqueue_heap::HeapBase<pqueue_heap<T,Pred,Insert,D>, _pqueue_heap::Node<T>, D>
+	{
+		private:
+			using Node = _pqueue_heap::Node<T>;
+			using base_t = _pqueue_heap::HeapBase<pqueue_heap, Node, D>;
+			friend base_t;
+			using base_t::_heap;
+			uint64_t	_seq = 0;
+			Pred		_pred;
+
+			bool _first(const Node& n0, const Node& n1) const {
+				if(_pred(n0.value, n1.value))
+					return true;
+				if(_pred(n1.value, n0.value))
+					return false;
+				return Insert::SeqFirst(n0.seq, n1.seq);
+			}
+			void _onPlace(std::size_t) noexcept {}
+
+		public:
+			pqueue_heap(const Pred& pred=Pred()):
+				_pred(pred)
+			{}
+			template <class TA>
+			void push(TA&& t) {
+				base_t::_push(Node{T(std::forward<TA>(t)), _seq++});
+			}
+			template <class... Ts>
+			void emplace(Ts&&... ts) {
+				base_t::_push(Node{T(std::forward<Ts>(ts)...), _seq++});
+			}
+			//! 複数の要素をまとめて追加(追加数が多い場合はヒープを組み直す)
+			template <class Itr>
+			void push_range(Itr first, Itr last) {
+				const std::size_t n = _heap.size();
+				for(; first!=last ; ++first)
+					_heap.push_back(Node{T(*first), _seq++});
+				if(_heap.size() != n)
+					base_t::_pushed(_heap.size() - n);
+			}
+			// 優先順位が変わってしまうかもしれないので参照はconstのみとする
+			const T& front() const {
+				D_Assert0(!base_t::empty());
+				return _heap.front().value;
+			}
+			void pop_front() {
+				base_t::_remove(0);
+			}
+			void pop_front(T& dst) {
+				dst = std::move(_heap.front().value);
+				pop_front();
+			}
+			void clear() noexcept {
+				_heap.clear();
+				_seq = 0;
+			}
+	};
+
+	namespace _pqueue_heap {
+		template <class T>
+		struct IndexedNode : Node<T> {
+			uint32_t	slot;
+		};
+	}
+	//! 要素をハンドルで指定して削除、優先度の変更ができる優先度付きキュー
+	/*!
+		push, pop_front, erase, updateがO(log n)
+		同じ優先度の要素の順番はpqueue_heapと同じ(updateした要素は再度pushしたものとして扱う)
+	*/
+	template <class T, class Pred=std::less<T>, class Insert=InsertAfter, std::size_t D=4>
+	class pqueue_indexed :
+		public _pqueue_heap::HeapBase<pqueue_indexed<T,Pred,Insert,D>, _pqueue_heap::IndexedNode<T>, D>
+	{
+		public:
+			//! 要素を指すハンドル(要素が取り除かれた後は無効になる)
+			struct Handle {
+				uint32_t	slot = ~uint32_t(0),
+							gen = 0;
+				bool operator == (const Handle& h) const noexcept {
+					return slot == h.slot && gen == h.gen;
+				}
+				bool operator != (const Handle& h) const noexcept {
+					return !(this->operator == (h));
+				}
+			};
+		private:
+			using Node = _pqueue_heap::IndexedNode<T>;
+			using base_t = _pqueue_heap::HeapBase<pqueue_indexed, Node, D>;
+			friend base_t;
+			using base_t::_heap;
+			//! ハンドル -> ヒープ内の位置
+			struct Slot {
+				uint32_t	pos,
+							gen = 0;
+				bool		used = false;
+			};
+			using SlotV = std::vector<Slot>;
+			using FreeV = std::vector<uint32_t>;
+			SlotV		_slot;
+			FreeV		_freeSlot;
+			uint64_t	_seq = 0;
+			Pred		_pred;
+
+			bool _first(const Node& n0, const Node& n1) const {
+				if(_pred(n0.value, n1.value))
+					return true;
+				if(_pred(n1.value, n0.value))
+					return false;
+				return Insert::SeqFirst(n0.seq, n1.seq);
+			}
+			void _onPlace(const std::size_t idx) noexcept {
+				_slot[_heap[idx].slot].pos = idx;
+			}
+			uint32_t _allocSlot() {
+				if(_freeSlot.empty()) {
+					_slot.emplace_back();
+					return _slot.size()-1;
+				}
+				const uint32_t ret = _freeSlot.back();
+				_freeSlot.pop_back();
+				return ret;
+			}
+			void _releaseSlot(const uint32_t s) {
+				auto& sl = _slot[s];
+				sl.used = false;
+				// 古いハンドルを無効化
+				++sl.gen;
+				_freeSlot.push_back(s);
+			}
+			std::size_t _pos(const Handle& h) const {
+				D_Assert(has(h), "invalid handle");
+				return _slot[h.slot].pos;
+			}
+			template <class TA>
+			Handle _pushNode(TA&& t) {
+				const uint32_t s = _allocSlot();
+				auto& sl = _slot[s];
+				sl.used = true;
+				base_t::_push(Node{{std::forward<TA>(t), _seq++}, s});
+				return Handle{s, sl.gen};
+			}
+
+		public:
+			using handle_t = Handle;
+			pqueue_indexed(const Pred& pred=Pred()):
+				_pred(pred)
+			{}
+			template <class TA>
+			handle_t push(TA&& t) {
+				return _pushNode(T(std::forward<TA>(t)));
+			}
+			template <class... Ts>
+			handle_t emplace(Ts&&... ts) {
+				return _pushNode(T(std::forward<Ts>(ts)...));
+			}
+			const T& front() const {
+				D_Assert0(!base_t::empty());
+				return _heap.front().value;
+			}
+			handle_t frontHandle() const {
+				D_Assert0(!base_t::empty());
+				const uint32_t s = _heap.front().slot;
+				return Handle{s, _slot[s].gen};
+			}
+			void pop_front() {
+				D_Assert0(!base_t::empty());
+				const uint32_t s = _heap.front().slot;
+				base_t::_remove(0);
+				_releaseSlot(s);
+			}
+			void pop_front(T& dst) {
+				dst = std::move(_heap.front().value);
+				pop_front();
+			}
+			//! ハンドルが有効な要素を指しているか
+			bool has(const handle_t& h) const noexcept {
+				return h.slot < _slot.size() &&
+						_slot[h.slot].used &&
+						_slot[h.slot].gen == h.gen;
+			}
+			const T& get(const handle_t& h) const {
+				return _heap[_pos(h)].value;
+			}
+			//! ハンドルが指す要素を削除
+			void erase(const handle_t& h) {
+				base_t::_remove(_pos(h));
+				_releaseSlot(h.slot);
+			}
+			//! ハンドルが指す要素の値(優先度)を変更
+			template <class TA>
+			void update(const handle_t& h, TA&& t) {
+				const std::size_t idx = _pos(h);
+				auto& n = _heap[idx];
+				n.value = std::forward<TA>(t);
+				n.seq = _seq++;
+				base_t::_fix(idx);
+			}
+			void clear() {
+				// 発行済みのハンドルを無効にする為、スロットは解放するだけに留める
+				for(auto& n : _heap)
+					_releaseSlot(n.slot);
+				_heap.clear();
+				_seq = 0;
+			}
+	};
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include "pqueue_heap.hpp"
+#include "bit.hpp"
+#include <array>
+#include <limits>
+#include <type_traits>
+
+namespace spi {
+	//! 要素そのものをキーとして使う
+	struct RadixKeyIdentity {
+		template <class T>
+		const T& operator()(const T& t) const noexcept {
+			return t;
+		}
+	};
+	//! 基数ヒープによる優先度付きキュー(キーの小さい順に取り出す)
+	/*!
+		キーは符号なし整数で、追加するキーは最後にfront/pop_frontで参照したキー以上でなければならない(単調性)
+		ダイクストラ法やイベントシミュレーションのように、取り出した時刻以降の物しか追加しない用途向け
+		push O(1), pop_front ならしO(log C) (C: キーの最大値と最小値の差)
+		同じキーの要素の取り出し順は不定
+		\tparam GetKey	要素からキーを取り出すファンクタ
+	*/
+	template <class T, class GetKey=RadixKeyIdentity>
+	class pqueue_radix {
+		public:
+			using key_t = std::decay_t<std::invoke_result_t<const GetKey&, const T&>>;
+		private:
+			static_assert(std::is_unsigned_v<key_t>, "radix heap key should be unsigned integer");
+			constexpr static std::size_t NBucket = std::numeric_limits<key_t>::digits + 1;
+			struct Node {
+				key_t	key;
+				T		value;
+			};
+			using Bucket = std::vector<Node>;
+			using BucketA = std::array<Bucket, NBucket>;
+
+			//! バケット[i]には基準キーとの排他的論理和の最上位ビットが(i-1)ビット目である要素が入る
+			/*! バケット[0]は基準キー(最後に参照したキー)と同じ要素
+				先頭の参照時に再分配する為、mutableとしている */
+			mutable BucketA		_bucket;
+			mutable key_t		_last = 0;
+			std::size_t	_size = 0;
+			GetKey		_getKey;
+
+			std::size_t _bucketIndex(const key_t key) const noexcept {
+				return BitWidth(key_t(key ^ _last));
+			}
+			//! バケット[0]が空なら、空でない最小のバケットを再分配する
+			void _refill() const {
+				D_Assert0(_size > 0);
+				if(!_bucket[0].empty())
+					return;
+				std::size_t i = 1;
+				while(_bucket[i].empty())
+					++i;
+				auto& b = _bucket[i];
+				// バケット内の最小キーを新たな基準とする
+				key_t mn = b[0].key;
+				for(auto& n : b)
+					mn = std::min(mn, n.key);
+				_last = mn;
+				// 基準との差が小さくなるので、全て下位のバケットへ移る
+				for(auto& n : b)
+					_bucket[_bucketIndex(n.key)].push_back(std::move(n));
+				b.clear();
+			}
+			void _pushNode(Node&& n) {
+				D_Assert(n.key >= _last, "radix heap key should be monotone");
+				_bucket[_bucketIndex(n.key)].push_back(std::move(n));
+				++_size;
+			}
+
+		public:
+			pqueue_radix(const GetKey& getKey=GetKey()):
+				_getKey(getKey)
+			{}
+			template <class TA>
+			void push(TA&& t) {
+				T tmp(std::forward<TA>(t));
+				const key_t key = _getKey(tmp);
+				_pushNode(Node{key, std::move(tmp)});
+			}
+			template <class... Ts>
+			void emplace(Ts&&... ts) {
+				push(T(std::forward<Ts>(ts)...));
+			}
+			template <class Itr>
+			void push_range(Itr first, Itr last) {
+				for(; first!=last ; ++first)
+					push(*first);
+			}
+			// キーが変わってしまうかもしれないので参照はconstのみとする
+			const T& front() const {
+				D_Assert0(!empty());
+				_refill();
+				return _bucket[0].back().value;
+			}
+			//! 最後に参照したキー(これ未満のキーは追加できない)
+			key_t lastKey() const noexcept {
+				return _last;
+			}
+			void pop_front() {
+				D_Assert0(!empty());
+				_refill();
+				_bucket[0].pop_back();
+				--_size;
+			}
+			void pop_front(T& dst) {
+				D_Assert0(!empty());
+				_refill();
+				dst = std::move(_bucket[0].back().value);
+				pop_front();
+			}
+			bool empty() const noexcept {
+				return _size == 0;
+			}
+			std::size_t size() const noexcept {
+				return _size;
+			}
+			//! 全ての要素を削除(キーの単調性の制約もリセットされる)
+			void clear() noexcept {
+				for(auto& b : _bucket)
+					b.clear();
+				_last = 0;
+				_size = 0;
+			}
+	};
+	//! キーが単調増加する符号なし整数ならpqueue_radix、それ以外はpqueue_heapを選択
+	/*! どちらもキーの小さい順(std::less)に取り出す */
+	template <class T, bool Monotone>
+	using pqueue_monotone = std::conditional_t<
+		Monotone && std::is_unsigned_v<T>,
+		pqueue_radix<T>,
+		pqueue_heap<T>
+	>;
+}
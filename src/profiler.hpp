@@ -104,10 +104,12 @@ namespace spi {
 				//! 1インターバル間に集計される情報
 				struct IntervalInfo {
 					using ByName = std::unordered_map<Name, History>;
+					using ByValue = std::unordered_map<Name, double>;
 
 					Timepoint	tmBegin;			//!< インターバル開始時刻
 					BlockSP		root;				//!< ツリー構造ルート
 					ByName		byName;				//!< 名前ブロック毎の集計(最大レイヤー数を超えた分も含める)
+					ByValue		value;				//!< setValue()で記録した値(インターバル内で最後に記録した物)
 				};
 			private:
 				using IntervalInfoSW = lubee::DataSwitcher<IntervalInfo>;
@@ -286,6 +288,17 @@ namespace spi {
 				Scope operator()(const Name& name) {
 					return beginScope(name);
 				}
+				//! 計測時間以外の値(統計情報など)を記録
+				void setValue(const Name& name, const double v) {
+					_intervalInfo.current().value[name] = v;
+				}
+				//! s.iterate(f)で列挙される(名前, 値)をまとめて記録
+				template <class S>
+				void setValues(const S& s) {
+					s.iterate([this](const Name& name, const double v){
+						setValue(name, v);
+					});
+				}
 				//! 同じ名前のブロックを合算したものを取得(前のインターバル)
 				const IntervalInfo& getPrev() const {
 					return _intervalInfo.prev();
@@ -4,6 +4,7 @@
 #include "optional.hpp"
 #include <unordered_map>
 #include <vector>
+#include <string_view>
 
 namespace spi {
 	#define RESMGRNAME_DEFINED
@@ -19,23 +20,15 @@ namespace spi {
 		ret.append(std::to_string(num));
 		return ret;
 	}
+	template <class Char, class Traits>
+	bool IsAnonymous(const std::basic_string_view<Char, Traits> key) {
+		using Key = std::basic_string<Char, Traits>;
+		const static std::basic_string_view<Char, Traits> c_prefix(GetAnonymousStr((Key*)nullptr));
+		return key.substr(0, c_prefix.size()) == c_prefix;
+	}
 	template <class Char, class Traits, class Alloc>
 	bool IsAnonymous(const std::basic_string<Char, Traits, Alloc>& key) {
-		using Key = std::decay_t<decltype(key)>;
-		const static Key c_prefix(GetAnonymousStr((Key*)nullptr));
-		const auto plen = c_prefix.size();
-		if(key.size() >= plen) {
-			auto itr0 = key.cbegin(),
-				 itr1 = c_prefix.cbegin();
-			do {
-				if(*itr0 != *itr1)
-					return false;
-				++itr0;
-				++itr1;
-			} while(itr1 != c_prefix.cend());
-			return true;
-		}
-		return false;
+		return IsAnonymous(std::basic_string_view<Char, Traits>(key));
 	}
 	//! 名前付きリソースマネージャ
 	/*!
@@ -53,10 +46,14 @@ namespace spi {
 			using shared_t = std::shared_ptr<value_t>;
 			using const_shared_t = std::shared_ptr<const value_t>;
 			using key_t = K;
+			//! 検索に使うキーの型(key_tを作らずに検索できる)
+			using view_t = std::basic_string_view<typename key_t::value_type, typename key_t::traits_type>;
 		private:
 			using this_t = ResMgrName<T,K>;
 			using tag_t = ResTag<value_t>;
-			using Map = std::unordered_map<key_t, tag_t>;
+			//! キーの実体はv2kが持ち、mapはそれを参照する
+			/*! (unordered_mapの要素はアドレスが変わらないので、v2kの要素を削除するまで有効) */
+			using Map = std::unordered_map<view_t, tag_t>;
 			using Val2Key = std::unordered_map<const value_t*, key_t>;
 			struct Resource {
 				Map			map;
@@ -105,8 +102,9 @@ namespace spi {
 					Assert0(itr != v2k.end());
 					const auto itr2 = m.find(itr->second);
 					Assert0(itr2 != m.end());
-					v2k.erase(itr);
+					// mapのキーはv2kの文字列を指しているので先に削除
 					m.erase(itr2);
+					v2k.erase(itr);
 					alc.destroy(p);
 					alc.deallocate(p, 1);
 				} catch(const std::exception& e) {
@@ -131,20 +129,19 @@ namespace spi {
 			template <class Ar, class T2, class K2>
 			friend void load(Ar&, ResMgrName<T2,K2>&);
 
-			key_t _convertKey(const key_t& s) {
-				if(!IsAnonymous(s)) {
-					key_t tk(s);
-					_modifyResourceName(tk);
-					return tk;
-				}
-				return s;
+			//! キーを正規化
+			/*! 改変が必要な場合のみbuffにコピーしてそれを指すビューを返し、それ以外は入力をそのまま返す */
+			view_t _normalizeKey(const view_t k, key_t& buff) const {
+				if(IsAnonymous(k) || !_modifyResourceName(k, buff))
+					return k;
+				return buff;
 			}
 			template <class T2>
 			auto _getDeleter() {
 				return [r=_resource](T2 *const p){ _Release(r, p); };
 			}
 			//! key->resource の関連付けを解除
-			tag_t _eraseKey2Tag(const key_t& k_from) {
+			tag_t _eraseKey2Tag(const view_t k_from) {
 				auto& m = _resource->map;
 				const auto itr = m.find(k_from);
 				D_Assert0(itr != m.end());
@@ -161,12 +158,12 @@ namespace spi {
 				v2k.erase(itr);
 			}
 			//! あるキーに関連付けられているリソースを別の名前と関連付けしなおす
-			void _renameEntry(const key_t& k_from, const key_t& k_to) {
+			void _renameEntry(const view_t k_from, const key_t& k_to) {
 				tag_t tag = _eraseKey2Tag(k_from);
 				_eraseV2K(tag.ptr);
 
-				_resource->map.emplace(k_to, tag);
-				_resource->v2k.emplace(tag.ptr, k_to);
+				const auto itr = _resource->v2k.emplace(tag.ptr, k_to).first;
+				_resource->map.emplace(itr->second, tag);
 			}
 			template <class T2, class Make>
 			auto _addEntry(const key_t& k, const Make& make) -> std::shared_ptr<T2> {
@@ -179,13 +176,22 @@ namespace spi {
 					_getDeleter<T2>()
 				);
 				auto& res = *_resource;
-				res.map.emplace(k, sp);
-				res.v2k.emplace(sp.get(), k);
+				const auto itr = res.v2k.emplace(sp.get(), k).first;
+				res.map.emplace(itr->second, sp);
 				return sp;
 			}
 		protected:
 			//! 継承先のクラスでキーの改変をする必要があればこれをオーバーライドする
-			virtual void _modifyResourceName(key_t& /*key*/) const {}
+			/*!
+				改変する場合はdstに改変後のキーを書き込んでtrueを返す
+				falseを返せばkeyをコピーせずにそのまま検索する
+			*/
+			virtual bool _modifyResourceName(const view_t /*key*/, key_t& /*dst*/) const {
+				return false;
+			}
+			//! 以前の形式(キーを直接書き換える)のフック
+			/*! これをオーバーライドしている継承先がコンパイルエラーになるよう、finalにして残してある */
+			virtual void _modifyResourceName(key_t& /*key*/) const final {}
 
 		public:
 			ResMgrName() {
@@ -231,25 +237,27 @@ namespace spi {
 
 			// ---- 名前付きリソース作成 ----
 			template <class T2, class Make>
-			auto acquireWithMake(const key_t& k, Make&& make) -> std::pair<std::shared_ptr<T2>, bool> {
-				const key_t tk = _convertKey(k);
+			auto acquireWithMake(const view_t k, Make&& make) -> std::pair<std::shared_ptr<T2>, bool> {
+				key_t buff;
+				const view_t tk = _normalizeKey(k, buff);
 				// 既に同じ名前でリソースを確保済みならばそれを返す
-				if(auto ret = get(tk))
+				if(auto ret = _find<shared_t>(tk))
 					return std::make_pair(std::static_pointer_cast<T2>(ret), false);
-				return std::make_pair(_addEntry<T2>(tk, make), true);
+				return std::make_pair(_addEntry<T2>(key_t(tk), make), true);
 			}
 			//! 型を指定してのリソース確保
 			template <class T2, class... Ts>
-			auto emplaceWithType(const key_t& k, Ts&&... ts) -> std::pair<std::shared_ptr<T2>, bool> {
+			auto emplaceWithType(const view_t k, Ts&&... ts) -> std::pair<std::shared_ptr<T2>, bool> {
 				return acquireWithMake<T2>(k, [&ts...](auto& /*key*/, auto&& mk){
 					mk(std::forward<Ts>(ts)...);
 				});
 			}
 			template <class... Ts>
-			auto emplace(const key_t& k, Ts&&... ts) -> std::pair<std::shared_ptr<value_t>, bool> {
+			auto emplace(const view_t k, Ts&&... ts) -> std::pair<std::shared_ptr<value_t>, bool> {
 				return emplaceWithType<value_t>(k, std::forward<Ts>(ts)...);
 			}
-			bool setAnonymous(const key_t& k, key_t* oldKey=nullptr) {
+			//! 正規化済みのキーに対応するリソースを無名リソースにする
+			bool _setAnonymous(const view_t k, key_t* oldKey) {
 				auto& m = _resource->map;
 				const auto itr = m.find(k);
 				if(itr != m.end()) {
@@ -261,25 +269,32 @@ namespace spi {
 				}
 				return false;
 			}
+			//! キーに対応するリソースを無名リソースにする
+			/*! \param[in] oldKey	有効なポインタを指定すれば新しいキー名がセットされる */
+			bool setAnonymous(const view_t k, key_t* oldKey=nullptr) {
+				key_t buff;
+				return _setAnonymous(_normalizeKey(k, buff), oldKey);
+			}
 			/*!
 				\param[in] oldKey	有効なポインタを指定すれば上書きされたリソースの新しいキー名がセットされる
 				\return std::pair(first=置き換えられた後のリソースハンドル, second=古いリソースが置き換えられたかのフラグ)
 			*/
 			template <class T2, class Make>
-			auto replaceWithMake(const key_t& k, const Make& make, key_t* oldKey=nullptr) {
-				const key_t tk = _convertKey(k);
+			auto replaceWithMake(const view_t k, const Make& make, key_t* oldKey=nullptr) {
+				key_t buff;
+				const key_t tk(_normalizeKey(k, buff));
 				// 既に同じ名前でリソースを確保済みならばキーを無名リソースキーに書き換え
-				const bool hasOld = setAnonymous(tk, oldKey);
+				const bool hasOld = _setAnonymous(tk, oldKey);
 				return std::make_pair(_addEntry<T2>(tk, make), hasOld);
 			}
 			template <class T2, class... Ts>
-			auto replaceEmplaceWithType(const key_t& k, key_t* oldKey, Ts&&... ts) {
+			auto replaceEmplaceWithType(const view_t k, key_t* oldKey, Ts&&... ts) {
 				return replaceWithMake<T2>(k, [&ts...](auto& /*key*/, auto&& mk){
 					mk(std::forward<Ts>(ts)...);
 				}, oldKey);
 			}
 			template <class... Ts>
-			auto replaceEmplace(const key_t& k, key_t* oldKey, Ts&&... ts) {
+			auto replaceEmplace(const view_t k, key_t* oldKey, Ts&&... ts) {
 				return replaceEmplaceWithType<value_t>(k, oldKey, std::forward<Ts>(ts)...);
 			}
 
@@ -318,11 +333,11 @@ namespace spi {
 					return itr->second;
 				return none;
 			}
+			//! 正規化済みのキーで検索
 			template <class Ret>
-			Ret _get(const key_t& k) {
-				const key_t tk = _convertKey(k);
+			Ret _find(const view_t k) {
 				auto& map = _resource->map;
-				const auto itr = map.find(tk);
+				const auto itr = map.find(k);
 				if(itr != map.end()) {
 					Ret ret(itr->second.weak.lock());
 					D_Assert0(ret);
@@ -330,11 +345,17 @@ namespace spi {
 				}
 				return nullptr;
 			}
+			template <class Ret>
+			Ret _get(const view_t k) {
+				// キーの改変が不要ならメモリ確保無しで検索できる
+				key_t buff;
+				return _find<Ret>(_normalizeKey(k, buff));
+			}
 			//! キーに対応するリソースを取り出す(ない場合はnullptrを返す)
-			shared_t get(const key_t& k) {
+			shared_t get(const view_t k) {
 				return _get<shared_t>(k);
 			}
-			const_shared_t get(const key_t& k) const {
+			const_shared_t get(const view_t k) const {
 				return const_cast<this_t&>(*this).template _get<const_shared_t>(k);
 			}
 			//! 確保されたリソース数
@@ -0,0 +1,582 @@
+#pragma once
+#include "resmgr_named.hpp"
+#include "worker_pool.hpp"
+#include <shared_mutex>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+namespace spi {
+	//! 複数スレッドから同時に使える名前付きリソースマネージャ
+	/*!
+		キーのハッシュ値でN個に分割したテーブルをそれぞれshared_mutexで保護する
+		get()はシャード毎に公開された読み取り専用のスナップショット(永続トライ)を検索し、シャードのロックを取らない
+		登録や解除ではトライの根から葉までの経路を複製して差し替える
+		リソースの解放(最後の参照が外れた時)はどのスレッドから行っても良い
+		ResMgrNameとの違い:
+			- キーの改変(_modifyResourceName)は行わない
+			- getKey()はshared_ptrからのみ、キーのコピーを返す(別スレッドで改名される可能性がある為)
+			- イテレータとシリアライズは無し
+			- acquireAsync()でワーカースレッドにリソースを作成させられる
+		acquireWithMake等でのリソースの作成(Make)はシャードの書き込みロック下で行うので、Makeの中から同じマネージャのリソースを確保してはいけない
+		acquireWithMake等はacquireAsync()で作成中のキーに対しては、その完了を待って結果を返す
+		(ワーカースレッドで動くMakeの中から作成中のキーを確保すると、ワーカーが足りずに止まる事がある)
+		\tparam NShard	シャード数(2の累乗)
+	*/
+	template <
+		class T,
+		class K = std::string,
+		std::size_t NShard = 16,
+		class Allocator = std::allocator<T>
+	>
+	class ResMgrNameConcurrent {
+		public:
+			using value_t = T;
+			using shared_t = std::shared_ptr<value_t>;
+			using const_shared_t = std::shared_ptr<const value_t>;
+			using key_t = K;
+			using view_t = std::basic_string_view<typename key_t::value_type, typename key_t::traits_type>;
+			using future_t = std::shared_future<shared_t>;
+		private:
+			static_assert(NShard > 0 && (NShard & (NShard-1)) == 0, "number of shards should be power of 2");
+			struct Shard;
+			//! リソース毎の登録情報(リソースと同じ寿命)
+			struct Entry {
+				key_t					key;
+				std::weak_ptr<value_t>	weak;
+				//! 登録されているシャード(登録されていなければnullptr、書き換えはシャードのロック下で行う)
+				std::atomic<Shard*>		shard{nullptr};
+
+				Entry(key_t key):
+					key(std::move(key))
+				{}
+			};
+			//! キーの実体はEntryが持ち、mapはそれを参照する
+			using Map = std::unordered_map<view_t, Entry*>;
+			//! スナップショットの要素(作成後は書き換えない)
+			struct SnapItem {
+				key_t					key;
+				std::weak_ptr<value_t>	weak;
+			};
+			using SnapItem_SP = std::shared_ptr<const SnapItem>;
+			//! get()用のスナップショット(ハッシュ値のビット列で分岐する永続トライ)
+			/*!
+				ノードは作成後に書き換えず、追加や削除では根から対象の葉までの経路だけを複製する
+				(書き込みのコストはシャード内のエントリ数ではなく、トライの深さに比例する)
+			*/
+			struct SnapNode;
+			using SnapNode_SP = std::shared_ptr<const SnapNode>;
+			//! 葉ノードの要素(検索時に要素を辿らずに済むよう、ハッシュ値を並べて持つ)
+			struct SnapLeaf {
+				std::size_t		hash_value;
+				SnapItem_SP		item;
+
+				bool match(const view_t k, const std::size_t hash) const noexcept {
+					return hash_value == hash && view_t(item->key) == k;
+				}
+			};
+			struct SnapNode {
+				std::vector<SnapLeaf>		item;		//!< 葉ノードの要素
+				std::vector<SnapNode_SP>	child;		//!< 内部ノードなら子(SnapFanout個)、葉なら空
+			};
+			constexpr static std::size_t SnapBit = 4,
+										SnapFanout = 1 << SnapBit,
+										//! 葉の要素数がこれを超えたら子に分割する
+										SnapLeafMax = 16,
+										SnapMaxDepth = sizeof(std::size_t)*8 / SnapBit;
+			static std::size_t _Hash(const view_t k) noexcept {
+				return std::hash<view_t>()(k);
+			}
+			static std::size_t _SnapSlot(const std::size_t hash, const std::size_t depth) noexcept {
+				return (hash >> (depth*SnapBit)) & (SnapFanout-1);
+			}
+			static const SnapItem* _SnapFind(const SnapNode* nd, const view_t k, const std::size_t hash) noexcept {
+				for(std::size_t depth=0 ; nd ; ++depth) {
+					if(nd->child.empty()) {
+						for(auto& it : nd->item) {
+							if(it.match(k, hash))
+								return it.item.get();
+						}
+						return nullptr;
+					}
+					nd = nd->child[_SnapSlot(hash, depth)].get();
+				}
+				return nullptr;
+			}
+			static SnapNode_SP _SnapInsert(const SnapNode* nd, SnapLeaf item, const std::size_t depth) {
+				auto ret = nd ? std::make_shared<SnapNode>(*nd) : std::make_shared<SnapNode>();
+				if(!ret->child.empty()) {
+					auto& c = ret->child[_SnapSlot(item.hash_value, depth)];
+					c = _SnapInsert(c.get(), std::move(item), depth+1);
+					return ret;
+				}
+				ret->item.push_back(std::move(item));
+				if(ret->item.size() > SnapLeafMax && depth+1 < SnapMaxDepth) {
+					// 葉が大きくなったら内部ノードにして、要素を子に振り分ける
+					std::vector<SnapLeaf> items;
+					items.swap(ret->item);
+					ret->child.resize(SnapFanout);
+					for(auto& it : items) {
+						auto& c = ret->child[_SnapSlot(it.hash_value, depth)];
+						c = _SnapInsert(c.get(), std::move(it), depth+1);
+					}
+				}
+				return ret;
+			}
+			static SnapNode_SP _SnapErase(const SnapNode_SP& nd, const view_t k, const std::size_t hash, const std::size_t depth) {
+				if(!nd)
+					return nullptr;
+				if(nd->child.empty()) {
+					const auto itr = std::find_if(nd->item.begin(), nd->item.end(), [k, hash](auto& it){
+						return it.match(k, hash);
+					});
+					if(itr == nd->item.end())
+						return nd;
+					if(nd->item.size() == 1)
+						return nullptr;
+					auto ret = std::make_shared<SnapNode>(*nd);
+					ret->item.erase(ret->item.begin() + (itr - nd->item.begin()));
+					return ret;
+				}
+				const std::size_t slot = _SnapSlot(hash, depth);
+				auto c = _SnapErase(nd->child[slot], k, hash, depth+1);
+				if(c == nd->child[slot])
+					return nd;
+				// 子が全て空になったらノードごと外す
+				if(!c && std::count(nd->child.begin(), nd->child.end(), nullptr) == SnapFanout-1)
+					return nullptr;
+				auto ret = std::make_shared<SnapNode>(*nd);
+				ret->child[slot] = std::move(c);
+				return ret;
+			}
+			//! acquireAsync()で作成中のリソース
+			using Pending = std::unordered_map<key_t, future_t>;
+			// 隣のシャードとキャッシュラインを共有しないようにする
+			struct alignas(64) Shard {
+				std::shared_mutex		mutex;
+				Map						map;
+				Pending					pending;
+				//! get()用のスナップショット(書き込みロック下でatomic_storeで差し替え、読み取りはatomic_loadのみ)
+				SnapNode_SP				snap;
+
+				//! 書き込みロック下でエントリの登録をスナップショットに反映
+				void snapAdd(const Entry& e) {
+					SnapLeaf item{_Hash(e.key), std::make_shared<const SnapItem>(SnapItem{e.key, e.weak})};
+					std::atomic_store_explicit(&snap, _SnapInsert(snap.get(), std::move(item), 0), std::memory_order_release);
+				}
+				//! 書き込みロック下でエントリの解除をスナップショットに反映
+				void snapErase(const view_t k) {
+					auto nd = _SnapErase(snap, k, _Hash(k), 0);
+					if(nd != snap)
+						std::atomic_store_explicit(&snap, std::move(nd), std::memory_order_release);
+				}
+			};
+			constexpr static std::size_t _Log2(const std::size_t n) noexcept {
+				return n <= 1 ? 0 : 1 + _Log2(n >> 1);
+			}
+			//! リソースよりマネージャが先に破棄されても良いよう、共有して保持する
+			struct Core {
+				std::array<Shard, NShard>	shard;
+				//! 無名リソースを作成する際の通し番号
+				std::atomic<uint64_t>		acounter{0};
+
+				Shard& getShard(const std::size_t hash) noexcept {
+					if constexpr (NShard == 1)
+						return shard[0];
+					else {
+						// テーブル内のバケット選択と相関しないよう、ハッシュ値を撹拌して上位ビットを使う
+						const uint64_t h = uint64_t(hash) * 0x9e3779b97f4a7c15ull;
+						return shard[h >> (64 - _Log2(NShard))];
+					}
+				}
+				Shard& getShard(const view_t k) noexcept {
+					return getShard(_Hash(k));
+				}
+				//! エントリをテーブルから外す
+				void unregister(Entry& e) {
+					for(;;) {
+						Shard* s = e.shard.load(std::memory_order_acquire);
+						if(!s)
+							return;
+						std::lock_guard lk(s->mutex);
+						// ロックを待つ間に別のシャードへ移された場合はやり直す
+						if(e.shard.load(std::memory_order_relaxed) != s)
+							continue;
+						s->map.erase(view_t(e.key));
+						s->snapErase(view_t(e.key));
+						e.shard.store(nullptr, std::memory_order_relaxed);
+						return;
+					}
+				}
+			};
+			using Core_SP = std::shared_ptr<Core>;
+			//! 最後の参照が外れたスレッドで呼ばれる
+			struct Deleter {
+				Core_SP		core;
+				Entry*		entry;
+
+				template <class T2>
+				void operator()(T2* p) const noexcept {
+					using Alc = typename std::allocator_traits<Allocator>::template rebind_alloc<T2>;
+					using Tr = std::allocator_traits<Alc>;
+					try {
+						core->unregister(*entry);
+						delete entry;
+						Alc alc;
+						Tr::destroy(alc, p);
+						Tr::deallocate(alc, p, 1);
+					} catch(const std::exception& e) {
+						AssertF("exception occurred (%s)", e.what());
+					} catch(...) {
+						AssertF("unknown exception occurred");
+					}
+				}
+			};
+			Core_SP		_core;
+			using Pool_SP = std::shared_ptr<WorkerPool>;
+			Pool_SP		_workerPool;
+			std::mutex	_poolMutex;
+
+			Pool_SP _getPool() {
+				std::lock_guard lk(_poolMutex);
+				if(!_workerPool)
+					_workerPool = std::make_shared<WorkerPool>();
+				return _workerPool;
+			}
+
+			key_t _makeAKey() {
+				return MakeAnonymous((key_t*)nullptr, _core->acounter.fetch_add(1, std::memory_order_relaxed));
+			}
+			//! リソースを作成(テーブルには登録しない)
+			template <class T2, class Make>
+			static auto _MakeResource(const Core_SP& core, key_t k, const Make& make) -> std::pair<std::shared_ptr<T2>, Entry*> {
+				std::unique_ptr<Entry> e(new Entry(std::move(k)));
+				Constructor<T2> ctor;
+				make(static_cast<const key_t&>(e->key), ctor);
+
+				std::shared_ptr<T2> sp(
+					ctor.release(),
+					Deleter{core, e.get()}
+				);
+				auto* ep = e.release();
+				ep->weak = sp;
+				return std::make_pair(std::move(sp), ep);
+			}
+			//! 書き込みロック済みのシャードにエントリを登録
+			static void _Register(Shard& s, Entry* e) {
+				s.map.emplace(view_t(e->key), e);
+				s.snapAdd(*e);
+				e->shard.store(&s, std::memory_order_release);
+			}
+			//! 書き込みロック済みのシャードにリソースを追加
+			template <class T2, class Make>
+			auto _addEntry(Shard& s, key_t k, const Make& make) -> std::shared_ptr<T2> {
+				auto ret = _MakeResource<T2>(_core, std::move(k), make);
+				_Register(s, ret.second);
+				return std::move(ret.first);
+			}
+			//! 書き込みロック済みのシャードから、解放待ちのエントリを外す
+			/*! \return 生存しているリソース(無ければnullptr) */
+			static shared_t _findLocked(Shard& s, const view_t k) {
+				const auto itr = s.map.find(k);
+				if(itr == s.map.end())
+					return nullptr;
+				if(auto ret = itr->second->weak.lock())
+					return ret;
+				// 他のスレッドで最後の参照が外れ、解放処理がロック待ちになっている
+				// -> エントリを先に外しておき、同じキーで新しく作れるようにする
+				// (nullptrを見た解放処理はエントリを削除するので、外した後にreleaseで書き込む)
+				Entry* e = itr->second;
+				s.map.erase(itr);
+				s.snapErase(k);
+				e->shard.store(nullptr, std::memory_order_release);
+				return nullptr;
+			}
+
+		public:
+			//! Makeに渡すリソースの構築用ファンクタ
+			/*! Makeが例外を投げた場合は確保した領域を解放する */
+			template <class T2>
+			struct Constructor {
+				using Alc = typename std::allocator_traits<Allocator>::template rebind_alloc<T2>;
+				using Tr = std::allocator_traits<Alc>;
+				Alc			alc;
+				T2*			pointer;
+				bool		constructed = false;
+				Constructor():
+					pointer(Tr::allocate(alc, 1))
+				{}
+				Constructor(const Constructor&) = delete;
+				~Constructor() {
+					if(pointer) {
+						if(constructed)
+							Tr::destroy(alc, pointer);
+						Tr::deallocate(alc, pointer, 1);
+					}
+				}
+				template <class... Ts>
+				void operator()(Ts&&... ts) {
+					D_Assert0(!constructed);
+					Tr::construct(alc, pointer, std::forward<Ts>(ts)...);
+					constructed = true;
+				}
+				//! 構築済みのリソースの所有権を手放す
+				T2* release() noexcept {
+					D_Assert(constructed, "resource is not constructed in Make");
+					T2* ret = pointer;
+					pointer = nullptr;
+					return ret;
+				}
+			};
+
+			ResMgrNameConcurrent() {
+				clear();
+			}
+			ResMgrNameConcurrent(const ResMgrNameConcurrent&) = delete;
+			ResMgrNameConcurrent& operator = (const ResMgrNameConcurrent&) = delete;
+			//! 全てのリソースの登録を解除(他のスレッドが操作していない時に呼ぶ)
+			/*! 確保済みのリソースはそのまま参照できる */
+			void clear() {
+				_core = std::make_shared<Core>();
+			}
+
+			// ---- 名前付きリソース作成 ----
+			template <class T2, class Make>
+			auto acquireWithMake(const view_t k, Make&& make) -> std::pair<std::shared_ptr<T2>, bool> {
+				auto& s = _core->getShard(k);
+				for(;;) {
+					future_t pending;
+					{
+						std::lock_guard lk(s.mutex);
+						// 既に同じ名前でリソースを確保済みならばそれを返す
+						if(auto ret = _findLocked(s, k))
+							return std::make_pair(std::static_pointer_cast<T2>(ret), false);
+						const auto itr = s.pending.find(key_t(k));
+						if(itr == s.pending.end())
+							return std::make_pair(_addEntry<T2>(s, key_t(k), make), true);
+						pending = itr->second;
+					}
+					// acquireAsync()で作成中ならロックを外して完了を待ち、同じリソースを返す
+					// (作成に失敗していたら、こちらで作り直す)
+					try {
+						if(auto ret = pending.get())
+							return std::make_pair(std::static_pointer_cast<T2>(std::move(ret)), false);
+					} catch(...) {}
+				}
+			}
+			//! 型を指定してのリソース確保
+			template <class T2, class... Ts>
+			auto emplaceWithType(const view_t k, Ts&&... ts) -> std::pair<std::shared_ptr<T2>, bool> {
+				return acquireWithMake<T2>(k, [&ts...](auto& /*key*/, auto&& mk){
+					mk(std::forward<Ts>(ts)...);
+				});
+			}
+			template <class... Ts>
+			auto emplace(const view_t k, Ts&&... ts) -> std::pair<std::shared_ptr<value_t>, bool> {
+				return emplaceWithType<value_t>(k, std::forward<Ts>(ts)...);
+			}
+			//! キーに対応するリソースを無名リソースにする
+			/*! \param[in] oldKey	有効なポインタを指定すれば新しいキー名がセットされる */
+			bool setAnonymous(const view_t k, key_t* oldKey=nullptr) {
+				auto& s0 = _core->getShard(k);
+				for(;;) {
+					key_t nk = _makeAKey();
+					auto& s1 = _core->getShard(nk);
+					// 2つのシャードのロックを取る(同じシャードなら1つ)
+					std::unique_lock lk0(s0.mutex, std::defer_lock),
+									lk1(s1.mutex, std::defer_lock);
+					if(&s0 == &s1)
+						lk0.lock();
+					else
+						std::lock(lk0, lk1);
+					const auto itr = s0.map.find(k);
+					if(itr == s0.map.end())
+						return false;
+					// 新しいキーが偶然使われていたら作り直す
+					if(s1.map.count(nk) != 0)
+						continue;
+					Entry* e = itr->second;
+					s0.map.erase(itr);
+					s0.snapErase(k);
+					e->key = std::move(nk);
+					s1.map.emplace(view_t(e->key), e);
+					s1.snapAdd(*e);
+					e->shard.store(&s1, std::memory_order_release);
+					if(oldKey)
+						*oldKey = e->key;
+					return true;
+				}
+			}
+			/*!
+				\param[in] oldKey	有効なポインタを指定すれば上書きされたリソースの新しいキー名がセットされる
+				\return std::pair(first=置き換えられた後のリソースハンドル, second=古いリソースが置き換えられたかのフラグ)
+			*/
+			template <class T2, class Make>
+			auto replaceWithMake(const view_t k, const Make& make, key_t* oldKey=nullptr) {
+				bool hasOld = false;
+				auto& s = _core->getShard(k);
+				for(;;) {
+					// 既に同じ名前でリソースを確保済みならばキーを無名リソースキーに書き換え
+					hasOld |= setAnonymous(k, oldKey);
+					// 最後の参照だった場合に備え、ロックを外してから解放する
+					shared_t exist;
+					std::lock_guard lk(s.mutex);
+					// 他のスレッドが同じ名前で確保していたらやり直す
+					if((exist = _findLocked(s, k)))
+						continue;
+					return std::make_pair(_addEntry<T2>(s, key_t(k), make), hasOld);
+				}
+			}
+			template <class T2, class... Ts>
+			auto replaceEmplaceWithType(const view_t k, key_t* oldKey, Ts&&... ts) {
+				return replaceWithMake<T2>(k, [&ts...](auto& /*key*/, auto&& mk){
+					mk(std::forward<Ts>(ts)...);
+				}, oldKey);
+			}
+			template <class... Ts>
+			auto replaceEmplace(const view_t k, key_t* oldKey, Ts&&... ts) {
+				return replaceEmplaceWithType<value_t>(k, oldKey, std::forward<Ts>(ts)...);
+			}
+
+			//! acquireAsync()でリソースを作成するスレッドを指定
+			/*! 指定しなければ最初にacquireAsync()を呼んだ時にハードウェアのスレッド数で作成する */
+			void setWorkerPool(Pool_SP pool) {
+				std::lock_guard lk(_poolMutex);
+				_workerPool = std::move(pool);
+			}
+			//! ワーカースレッドでリソースを作成する
+			/*!
+				既に確保済みなら完了済みのfutureを、同じキーを作成中ならそれと同じfutureを返す
+				makeはコピーして保持し、ワーカースレッドでロックを取らずに呼ぶ
+				作成中に同じキーがacquireWithMake等で確保された場合はその完了を待つが、
+				replaceWithMake等で置き換えられた場合は、作成した物を破棄してそちらを返す
+				makeが例外を投げた場合はfutureのget()でその例外が投げられる
+				タスクの投入に失敗した場合は作成中の登録を取り消し、その例外をそのまま投げる
+				\tparam T2	作成するリソースの型
+			*/
+			template <class T2=value_t, class Make>
+			future_t acquireAsync(const view_t k, Make make) {
+				const Core_SP core = _core;
+				auto& s = core->getShard(k);
+				// スレッドの起動はシャードのロックを取る前に済ませておく
+				const Pool_SP pool = _getPool();
+				// 最後の参照だった場合に備え、ロックを外してから解放する
+				shared_t exist;
+				std::lock_guard lk(s.mutex);
+				if((exist = _findLocked(s, k))) {
+					std::promise<shared_t> pr;
+					pr.set_value(exist);
+					return pr.get_future().share();
+				}
+				key_t key(k);
+				// 作成中なら同じfutureを返す
+				if(const auto itr = s.pending.find(key); itr != s.pending.end())
+					return itr->second;
+				const auto pr = std::make_shared<std::promise<shared_t>>();
+				future_t ret = pr->get_future().share();
+				const auto pitr = s.pending.emplace(key, ret).first;
+				try {
+					// タスクはマネージャではなくCoreを参照する(マネージャが先に破棄されても良い)
+					pool->post([core, key=std::move(key), make=std::move(make), pr](){
+						auto& sh = core->getShard(key);
+						try {
+							// 作成はロックを取らずに行う
+							auto res = _MakeResource<T2>(core, key, make);
+							shared_t out,
+									found;
+							{
+								std::lock_guard lk(sh.mutex);
+								sh.pending.erase(key);
+								if((found = _findLocked(sh, key)))
+									out = found;
+								else {
+									_Register(sh, res.second);
+									out = res.first;
+								}
+							}
+							// 登録しなかった場合、作成したリソースはここ(ロックの外)で破棄される
+							pr->set_value(std::move(out));
+						} catch(...) {
+							{
+								std::lock_guard lk(sh.mutex);
+								sh.pending.erase(key);
+							}
+							pr->set_exception(std::current_exception());
+						}
+					});
+				} catch(...) {
+					// 誰もfutureを受け取っていないので、登録を消せば待ち続けるスレッドは無い
+					s.pending.erase(pitr);
+					throw;
+				}
+				return ret;
+			}
+
+			// ---- 無名リソース作成 ----
+			template <class P, class... Ts>
+			auto acquireA(Ts&&... ts) -> std::shared_ptr<P> {
+				for(;;) {
+					const auto key = _makeAKey();
+					auto& s = _core->getShard(key);
+					std::lock_guard lk(s.mutex);
+					// 適当にリソース名を生成して、ダブりがなければOK
+					if(s.map.count(key) != 0)
+						continue;
+					return _addEntry<P>(s, key, [&ts...](auto& /*key*/, auto&& mk){
+						mk(std::forward<Ts>(ts)...);
+					});
+				}
+			}
+			//! データ型を指定しての無名リソース確保
+			template <class T2, class... Ts>
+			auto emplaceA_WithType(Ts&&... ts) -> std::shared_ptr<T2> {
+				return acquireA<T2>(std::forward<Ts>(ts)...);
+			}
+			//! 無名リソース確保(データ型 = value_t>
+			template <class... Ts>
+			auto emplaceA(Ts&&... ts) -> std::shared_ptr<value_t> {
+				return emplaceA_WithType<value_t>(std::forward<Ts>(ts)...);
+			}
+
+			//! リソースに対応するキーを取得
+			/*! 管轄外のリソースを入力した場合、noneが返る */
+			Optional<key_t> getKey(const const_shared_t& p) const {
+				const auto* d = std::get_deleter<Deleter>(p);
+				if(!d || d->core != _core)
+					return none;
+				const Entry& e = *d->entry;
+				for(;;) {
+					Shard* s = e.shard.load(std::memory_order_acquire);
+					if(!s)
+						return none;
+					std::shared_lock lk(s->mutex);
+					if(e.shard.load(std::memory_order_relaxed) == s)
+						return e.key;
+				}
+			}
+			//! キーに対応するリソースを取り出す(ない場合はnullptrを返す)
+			/*! シャードのロックは取らず、スナップショットを検索する */
+			shared_t get(const view_t k) {
+				const std::size_t hash = _Hash(k);
+				const auto snap = std::atomic_load_explicit(&_core->getShard(hash).snap, std::memory_order_acquire);
+				if(const auto* it = _SnapFind(snap.get(), k, hash))
+					return it->weak.lock();
+				return nullptr;
+			}
+			const_shared_t get(const view_t k) const {
+				return const_cast<ResMgrNameConcurrent&>(*this).get(k);
+			}
+			//! 確保されたリソース数(他のスレッドが操作中の場合は近似値)
+			std::size_t size() const {
+				std::size_t ret = 0;
+				for(auto& s : _core->shard) {
+					std::shared_lock lk(s.mutex);
+					ret += s.map.size();
+				}
+				return ret;
+			}
+	};
+}
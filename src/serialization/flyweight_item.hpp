@@ -2,22 +2,124 @@
 #include "../flyweight_item.hpp"
 #include <cereal/access.hpp>
 #include <cereal/types/memory.hpp>
+#include <cereal/types/vector.hpp>
+#include <cereal/details/helpers.hpp>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
 
 namespace spi {
-	template <class Ar, class T, class FH, class FC>
-	void save(Ar& ar, const FlyweightItem<T,FH,FC>& f) {
+	template <class Ar, class T, class FH, class FC, class P>
+	void save(Ar& ar, const FlyweightItem<T,FH,FC,P>& f) {
 		ar(f._sp);
 	}
-	template <class Ar, class T, class FH, class FC>
-	void load(Ar& ar, FlyweightItem<T,FH,FC>& f) {
-		using FW = FlyweightItem<T,FH,FC>;
+	template <class Ar, class T, class FH, class FC, class P>
+	void load(Ar& ar, FlyweightItem<T,FH,FC,P>& f) {
+		using FW = FlyweightItem<T,FH,FC,P>;
 		using V = typename FW::value_t;
 		std::shared_ptr<V> sp;
 		ar(sp);
 		f = FW(std::move(*sp));
 	}
+	namespace flyweight {
+		//! FlyweightItemの配列を値のテーブルとインデックス列でシリアライズする
+		/*!
+			ar(flyweight::AsTable(vec)) の様に使う
+			異なる値を1度ずつ"table"に書き出し、各アイテムをテーブルのインデックスとして"index"に書き出す
+			読み込み時は異なる値毎に1度だけ登録し、アイテムにはインデックスから引いたものを割り当てる
+			(範囲外のインデックスがあればcereal::Exceptionを送出する)
+			\tparam V	FlyweightItemを要素に持つ、size(), resize(), operator[]を備えたコンテナ
+		*/
+		template <class V>
+		struct TableRef {
+			V&	value;
+		};
+		template <class V>
+		TableRef<V> AsTable(V& v) noexcept {
+			return {v};
+		}
+		//! 値を持たないアイテムのインデックス
+		constexpr uint32_t NullIndex = ~uint32_t(0);
+
+		namespace detail {
+			//! 値のテーブル(書き出し用、値をコピーせずに参照する)
+			template <class T>
+			struct TableSave {
+				const std::vector<const T*>&	value;
+			};
+			template <class Ar, class T>
+			void save(Ar& ar, const TableSave<T>& t) {
+				ar(cereal::make_size_tag(static_cast<cereal::size_type>(t.value.size())));
+				for(auto* v : t.value)
+					ar(*v);
+			}
+			//! 値のテーブル(読み込み用、値を1度ずつ登録する)
+			template <class FW>
+			struct TableLoad {
+				std::vector<FW>&	value;
+			};
+			template <class Ar, class FW>
+			void load(Ar& ar, TableLoad<FW>& t) {
+				using value_t = typename FW::value_t;
+				cereal::size_type size;
+				ar(cereal::make_size_tag(size));
+				// サイズは信用せず、読めた分だけ確保する
+				t.value.clear();
+				for(cereal::size_type i=0 ; i<size ; i++) {
+					value_t v;
+					ar(v);
+					t.value.emplace_back(std::move(v));
+				}
+			}
+		}
+		template <class Ar, class V>
+		void save(Ar& ar, const TableRef<V>& t) {
+			using value_t = typename V::value_type::value_t;
+			const auto& src = t.value;
+			// 値のアドレス -> テーブルのインデックス(出現順)
+			std::unordered_map<const value_t*, uint32_t> index;
+			std::vector<const value_t*> table;
+			std::vector<uint32_t> idx;
+			idx.reserve(src.size());
+			for(auto& f : src) {
+				if(!f) {
+					idx.push_back(NullIndex);
+					continue;
+				}
+				const auto [itr, added] = index.emplace(f.get(), uint32_t(table.size()));
+				if(added)
+					table.push_back(f.get());
+				idx.push_back(itr->second);
+			}
+			const detail::TableSave<value_t> ts{table};
+			ar(cereal::make_nvp("table", ts), cereal::make_nvp("index", idx));
+		}
+		template <class Ar, class V>
+		void load(Ar& ar, TableRef<V>& t) {
+			using FW = typename V::value_type;
+			std::vector<FW> table;
+			detail::TableLoad<FW> tl{table};
+			std::vector<uint32_t> idx;
+			ar(cereal::make_nvp("table", tl), cereal::make_nvp("index", idx));
+			// 不正なインデックスがあれば読み込み先を変更せずに失敗させる
+			for(auto i : idx) {
+				if(i != NullIndex && i >= table.size())
+					throw cereal::Exception("invalid flyweight table index");
+			}
+			auto& dst = t.value;
+			dst.resize(idx.size());
+			for(std::size_t i=0 ; i<idx.size() ; i++) {
+				if(idx[i] == NullIndex)
+					dst[i] = FW();
+				else
+					dst[i] = table[idx[i]];
+			}
+		}
+	}
 }
 namespace cereal {
-	template <class Ar, class T, class FH, class FC>
-	struct specialize<Ar, spi::FlyweightItem<T,FH,FC>, cereal::specialization::non_member_load_save> {};
+	template <class Ar, class T, class FH, class FC, class P>
+	struct specialize<Ar, spi::FlyweightItem<T,FH,FC,P>, cereal::specialization::non_member_load_save> {};
+	template <class Ar, class V>
+	struct specialize<Ar, spi::flyweight::TableRef<V>, cereal::specialization::non_member_load_save> {};
 }
@@ -26,6 +26,23 @@ namespace spi {
 				cereal::make_nvp("ids", ent.ids)
 			);
 		}
+		template <class Ar, class Value, class Id>
+		void serialize(Ar& ar, DeltaRecord<Value,Id>& rec) {
+			ar(
+				cereal::make_nvp("id", rec.id),
+				cereal::make_nvp("ids", rec.ids),
+				cereal::make_nvp("value", rec.value)
+			);
+		}
+		template <class Ar, class Value, class Id>
+		void serialize(Ar& ar, Delta<Value,Id>& d) {
+			ar(
+				cereal::make_nvp("n_id", d.nId),
+				cereal::make_nvp("n_free", d.nFree),
+				cereal::make_nvp("first_free", d.firstFree),
+				cereal::make_nvp("record", d.record)
+			);
+		}
 	}
 	template <class Ar, class T, class Alc, class Id>
 	void serialize(Ar& ar, noseq_list<T,Alc,Id>& nl) {
@@ -0,0 +1,439 @@
+//! noseq_list, noseq_vecの生バイナリスナップショット
+/*!
+	値配列、UID配列、ID表をアラインされたブロックのまま書き出す
+	要素毎のシリアライズ処理を経由しないので、trivially copyableな要素型に限る
+	(異なるアーキテクチャ間での互換性は考慮しない。要素型の一致はサイズでしか確認しない)
+*/
+#pragma once
+#include "../noseq_list.hpp"
+#include "../noseq_vec.hpp"
+#include <istream>
+#include <ostream>
+#include <cstring>
+#if __has_include(<sys/mman.h>)
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#define SPI_SNAPSHOT_MMAP
+#endif
+
+namespace spi::snapshot {
+	DefineEnum(Kind, (Vec)(List));
+	//! ファイル先頭に置かれるヘッダ
+	struct Header {
+		constexpr static uint32_t	c_magic = 0x534e5053,		//!< "SPNS"
+									c_version = 1;
+		uint32_t	magic,
+					version,
+					kind,
+					valueSize,		//!< sizeof(value_t)
+					idSize,			//!< sizeof(id_t)
+					idsSize;		//!< ID表1要素のサイズ
+		uint64_t	nValue,			//!< 値の数
+					nId,			//!< ID表の長さ
+					nFree,
+					firstFree,
+					offValue,		//!< 各ブロックのファイル先頭からのオフセット
+					offUid,
+					offIds;
+	};
+	//! 各ブロックの開始位置をこの値に揃える
+	constexpr std::size_t BlockAlign = 64;
+	inline uint64_t AlignBlock(const uint64_t pos) {
+		return (pos + (BlockAlign-1)) / BlockAlign * BlockAlign;
+	}
+	namespace detail {
+		inline void WritePadding(std::ostream& os, uint64_t& cur, const uint64_t to) {
+			D_Assert0(cur <= to);
+			const char zero[BlockAlign] = {};
+			os.write(zero, to - cur);
+			cur = to;
+		}
+		inline void WriteBlock(std::ostream& os, uint64_t& cur, const uint64_t to, const void* src, const uint64_t len) {
+			WritePadding(os, cur, to);
+			os.write(static_cast<const char*>(src), len);
+			cur += len;
+		}
+		inline bool ReadBlock(std::istream& is, uint64_t& cur, const uint64_t from, void* dst, const uint64_t len) {
+			D_Assert0(cur <= from);
+			is.ignore(from - cur);
+			is.read(static_cast<char*>(dst), len);
+			cur = from + len;
+			return static_cast<bool>(is);
+		}
+		//! ストリームから読む場合の長さの上限(ignore()に渡せる範囲)
+		constexpr uint64_t StreamLimit = std::numeric_limits<std::streamsize>::max();
+		//! n要素の配列を読み込む
+		/*! 要素数はヘッダの値なので信用せず、読めた分だけ段階的に領域を広げる */
+		template <class V>
+		bool ReadArray(std::istream& is, uint64_t& cur, const uint64_t from, V& dst, const uint64_t n) {
+			using value_t = typename V::value_type;
+			D_Assert0(cur <= from);
+			is.ignore(from - cur);
+			cur = from;
+			dst.clear();
+			constexpr uint64_t MinChunk = (uint64_t(1) << 16) / sizeof(value_t) + 1;
+			while(dst.size() < n) {
+				const uint64_t sz = dst.size(),
+								add = std::min(n - sz, std::max(MinChunk, sz));
+				dst.resize(sz + add);
+				is.read(reinterpret_cast<char*>(dst.data() + sz), add*sizeof(value_t));
+				if(!is)
+					return false;
+			}
+			cur = from + n*sizeof(value_t);
+			return true;
+		}
+		//! off+n*size <= limit を桁溢れせずに判定し、ブロックの終端を返す
+		inline bool BlockEnd(const uint64_t off, const uint64_t n, const uint64_t size, const uint64_t limit, uint64_t& end) noexcept {
+			if(off > limit || (size != 0 && n > (limit - off) / size))
+				return false;
+			end = off + n*size;
+			return true;
+		}
+		template <class T>
+		bool CheckHeader(const Header& h, const Kind kind, const uint32_t idSize, const uint32_t idsSize) noexcept {
+			return h.magic == Header::c_magic &&
+					h.version == Header::c_version &&
+					h.kind == kind &&
+					h.valueSize == sizeof(T) &&
+					h.idSize == idSize &&
+					h.idsSize == idsSize;
+		}
+		//! 各ブロックが正しくアラインされ、重ならずに並び、limitバイト以内に収まるか
+		inline bool CheckBlocks(const Header& h, const uint64_t nValue, const uint64_t nUid, const uint64_t nIds, const uint64_t limit) noexcept {
+			uint64_t end = sizeof(Header);
+			// 前のブロックの後ろから始まり、(要素があれば)アラインされている事
+			const auto block = [&end, limit](const uint64_t off, const uint64_t n, const uint64_t size) {
+				return off >= end &&
+						(n == 0 || off % BlockAlign == 0) &&
+						BlockEnd(off, n, size, limit, end);
+			};
+			return block(h.offValue, nValue, h.valueSize) &&
+					block(h.offUid, nUid, h.idSize) &&
+					block(h.offIds, nIds, h.idsSize);
+		}
+		//! noseq_vecのヘッダが正しいか(要素を読み込む前、領域を確保する前に呼ぶ)
+		/*! \param[in] limit	スナップショットの長さの上限 */
+		template <class T>
+		bool CheckVecHeader(const Header& h, const uint64_t limit) noexcept {
+			return CheckHeader<T>(h, Kind::Vec, 0, 0) &&
+					h.nId == 0 && h.nFree == 0 &&
+					CheckBlocks(h, h.nValue, 0, 0, limit);
+		}
+		//! noseq_listのヘッダが正しいか(要素を読み込む前、領域を確保する前に呼ぶ)
+		template <class T, class Id>
+		bool CheckListHeader(const Header& h, const uint64_t limit) noexcept {
+			return CheckHeader<T>(h, Kind::List, sizeof(Id), sizeof(_noseq_list::IDS<Id>)) &&
+					h.nId <= std::numeric_limits<Id>::max() &&
+					h.nValue <= h.nId &&
+					h.nFree == h.nId - h.nValue &&
+					(h.nFree == 0 || h.firstFree < h.nId) &&
+					CheckBlocks(h, h.nValue, h.nId, h.nId, limit);
+		}
+		//! ID表とUID配列が互いに矛盾していないか(noseq_listへ展開する前に呼ぶ)
+		/*! 生存要素のIDと密配列の位置が1対1に対応し、フリーリストが全ての空きIDを辿るかを調べる */
+		template <class Id>
+		bool CheckIds(const Header& h, const Id* uid, const _noseq_list::IDS<Id>* ids) {
+			using ids_t = _noseq_list::IDS<Id>;
+			uint64_t nObj = 0;
+			for(uint64_t i=0 ; i<h.nId ; i++) {
+				const auto& e = ids[i];
+				if(e.type == ids_t::Type::Obj) {
+					if(e.value >= h.nValue || uid[e.value] != i)
+						return false;
+					++nObj;
+				} else if(e.type != ids_t::Type::Free)
+					return false;
+			}
+			if(nObj != h.nValue)
+				return false;
+			// フリーリストの末尾の値は不定なので、nFree個だけ辿る
+			std::vector<bool> visited(h.nId);
+			uint64_t cur = h.firstFree;
+			for(uint64_t i=0 ; i<h.nFree ; i++) {
+				if(cur >= h.nId || visited[cur] || ids[cur].type != ids_t::Type::Free)
+					return false;
+				visited[cur] = true;
+				cur = ids[cur].value;
+			}
+			return true;
+		}
+		template <class T>
+		constexpr void CheckType() noexcept {
+			static_assert(std::is_trivially_copyable_v<T>, "snapshot requires trivially copyable value type");
+		}
+	}
+	//! noseq_list, noseq_vecの内部にアクセスする為のクラス
+	struct Access {
+		template <class T, class AL>
+		static void Save(std::ostream& os, const noseq_vec<T,AL>& v) {
+			detail::CheckType<T>();
+			Header h{};
+			h.magic = Header::c_magic;
+			h.version = Header::c_version;
+			h.kind = Kind::Vec;
+			h.valueSize = sizeof(T);
+			h.nValue = v.size();
+			h.offValue = AlignBlock(sizeof(Header));
+			h.offUid = h.offIds = h.offValue + h.nValue*sizeof(T);
+
+			uint64_t cur = 0;
+			detail::WriteBlock(os, cur, 0, &h, sizeof(h));
+			detail::WriteBlock(os, cur, h.offValue, v.data(), h.nValue*sizeof(T));
+		}
+		template <class T, class AL>
+		static bool Load(std::istream& is, noseq_vec<T,AL>& v) {
+			detail::CheckType<T>();
+			Header h;
+			uint64_t cur = 0;
+			if(!detail::ReadBlock(is, cur, 0, &h, sizeof(h)) ||
+				!detail::CheckVecHeader<T>(h, detail::StreamLimit))
+				return false;
+			return detail::ReadArray(is, cur, h.offValue, v, h.nValue);
+		}
+		template <class T, class AL, class Id>
+		static void Save(std::ostream& os, const noseq_list<T,AL,Id>& l) {
+			detail::CheckType<T>();
+			using ids_t = _noseq_list::IDS<Id>;
+			D_Assert0(!l._bRemoving && l._remList.empty());
+			const auto& ar = l._array;
+			Header h{};
+			h.magic = Header::c_magic;
+			h.version = Header::c_version;
+			h.kind = Kind::List;
+			h.valueSize = sizeof(T);
+			h.idSize = sizeof(Id);
+			h.idsSize = sizeof(ids_t);
+			h.nValue = l.size();
+			h.nId = ar.size();
+			h.nFree = l._nFree;
+			h.firstFree = (l._nFree > 0) ? l._firstFree : 0;
+			h.offValue = AlignBlock(sizeof(Header));
+			h.offUid = AlignBlock(h.offValue + h.nValue*sizeof(T));
+			h.offIds = AlignBlock(h.offUid + h.nId*sizeof(Id));
+
+			// 値, UID, ID表はEntryの中に混在しているので、ブロック毎に纏め直して書き出す
+			std::vector<T> value(h.nValue);
+			std::vector<Id> uid(h.nId);
+			std::vector<ids_t> ids(h.nId);
+			for(std::size_t i=0 ; i<h.nId ; i++) {
+				auto& e = ar[i];
+				if(i < h.nValue)
+					std::memcpy(&value[i], &*e.udata.value, sizeof(T));
+				uid[i] = e.udata.uid;
+				ids[i] = e.ids;
+			}
+			uint64_t cur = 0;
+			detail::WriteBlock(os, cur, 0, &h, sizeof(h));
+			detail::WriteBlock(os, cur, h.offValue, value.data(), h.nValue*sizeof(T));
+			detail::WriteBlock(os, cur, h.offUid, uid.data(), h.nId*sizeof(Id));
+			detail::WriteBlock(os, cur, h.offIds, ids.data(), h.nId*sizeof(ids_t));
+		}
+		//! 各ブロックを指すポインタからnoseq_listを再構築
+		/*! \return ID表が不正な場合はfalse(リストは変更しない) */
+		template <class T, class AL, class Id>
+		static bool Build(
+			noseq_list<T,AL,Id>& l,
+			const Header& h,
+			const T* value,
+			const Id* uid,
+			const _noseq_list::IDS<Id>* ids
+		) {
+			detail::CheckType<T>();
+			if(!detail::CheckIds(h, uid, ids))
+				return false;
+			l.clear();
+			auto& ar = l._array;
+			ar.reserve(h.nId);
+			for(std::size_t i=0 ; i<h.nId ; i++) {
+				if(i < h.nValue)
+					ar.emplace_back(spi::Optional<T>(value[i]), uid[i], ids[i]);
+				else
+					ar.emplace_back(spi::Optional<T>(), uid[i], ids[i]);
+			}
+			l._nFree = h.nFree;
+			l._firstFree = h.firstFree;
+			return true;
+		}
+		template <class T, class AL, class Id>
+		static bool Load(std::istream& is, noseq_list<T,AL,Id>& l) {
+			using ids_t = _noseq_list::IDS<Id>;
+			Header h;
+			uint64_t cur = 0;
+			if(!detail::ReadBlock(is, cur, 0, &h, sizeof(h)) ||
+				!detail::CheckListHeader<T,Id>(h, detail::StreamLimit))
+				return false;
+			std::vector<T> value;
+			std::vector<Id> uid;
+			std::vector<ids_t> ids;
+			if(!detail::ReadArray(is, cur, h.offValue, value, h.nValue) ||
+				!detail::ReadArray(is, cur, h.offUid, uid, h.nId) ||
+				!detail::ReadArray(is, cur, h.offIds, ids, h.nId))
+				return false;
+			return Build(l, h, value.data(), uid.data(), ids.data());
+		}
+	};
+
+	//! スナップショットの書き出し
+	template <class C>
+	void Save(std::ostream& os, const C& c) {
+		Access::Save(os, c);
+	}
+	//! スナップショットの読み込み
+	/*! \return ヘッダやID表が不正、又は読み込みに失敗した場合はfalse(その場合、内容は不定) */
+	template <class C>
+	bool Load(std::istream& is, C& c) {
+		return Access::Load(is, c);
+	}
+
+	//! メモリ上に置かれたnoseq_vecのスナップショットを直接参照する
+	template <class T>
+	class VecView {
+		private:
+			const T*		_value = nullptr;
+			std::size_t		_size = 0;
+		public:
+			VecView() = default;
+			//! \param[in] src スナップショット先頭(BlockAlign以上でアラインされている事)
+			VecView(const void* src, const std::size_t len) {
+				detail::CheckType<T>();
+				Header h;
+				if(len < sizeof(h))
+					return;
+				std::memcpy(&h, src, sizeof(h));
+				if(!detail::CheckVecHeader<T>(h, len))
+					return;
+				_value = reinterpret_cast<const T*>(static_cast<const uint8_t*>(src) + h.offValue);
+				_size = h.nValue;
+			}
+			explicit operator bool () const noexcept {
+				return _value != nullptr;
+			}
+			const T* data() const noexcept { return _value; }
+			const T* begin() const noexcept { return _value; }
+			const T* end() const noexcept { return _value + _size; }
+			std::size_t size() const noexcept { return _size; }
+			const T& operator[](const std::size_t n) const noexcept {
+				D_Assert0(n < _size);
+				return _value[n];
+			}
+	};
+	//! メモリ上に置かれたnoseq_listのスナップショットを直接参照する
+	template <class T, class Id=uint_fast32_t>
+	class ListView {
+		private:
+			using ids_t = _noseq_list::IDS<Id>;
+			Header			_header{};
+			const T*		_value = nullptr;
+			const Id*		_uid = nullptr;
+			const ids_t*	_ids = nullptr;
+
+			template <class P>
+			static const P* _At(const void* src, const uint64_t off) noexcept {
+				return reinterpret_cast<const P*>(static_cast<const uint8_t*>(src) + off);
+			}
+		public:
+			ListView() = default;
+			//! \param[in] src スナップショット先頭(BlockAlign以上でアラインされている事)
+			ListView(const void* src, const std::size_t len) {
+				detail::CheckType<T>();
+				if(len < sizeof(_header))
+					return;
+				std::memcpy(&_header, src, sizeof(_header));
+				const auto& h = _header;
+				if(!detail::CheckListHeader<T,Id>(h, len))
+					return;
+				_value = _At<T>(src, h.offValue);
+				_uid = _At<Id>(src, h.offUid);
+				_ids = _At<ids_t>(src, h.offIds);
+			}
+			explicit operator bool () const noexcept {
+				return _ids != nullptr;
+			}
+			//! 密配列(noseq_listのbegin()〜end()と同じ並び)
+			const T* begin() const noexcept { return _value; }
+			const T* end() const noexcept { return _value + size(); }
+			std::size_t size() const noexcept { return _value ? _header.nValue : 0; }
+			//! IDが有効か判定(ID表の中身は検証していないので、値の位置も範囲内か確かめる)
+			bool has(const Id id) const noexcept {
+				return _ids &&
+						id < _header.nId &&
+						_ids[id].type == ids_t::Type::Obj &&
+						_ids[id].value < _header.nValue;
+			}
+			const T& get(const Id id) const noexcept {
+				D_Assert0(has(id));
+				return _value[_ids[id].value];
+			}
+			//! 密配列の位置に対応するIDを取得
+			Id idAt(const std::size_t idx) const noexcept {
+				D_Assert0(idx < size());
+				return _uid[idx];
+			}
+			//! noseq_listへ展開
+			/*! \return ID表が不正な場合はfalse */
+			template <class AL>
+			bool copyTo(noseq_list<T,AL,Id>& l) const {
+				D_Assert0(*this);
+				return Access::Build(l, _header, _value, _uid, _ids);
+			}
+	};
+
+	#ifdef SPI_SNAPSHOT_MMAP
+	//! 読み込み専用でファイルをメモリにマップする
+	class MappedFile {
+		private:
+			void*			_ptr = nullptr;
+			std::size_t		_size = 0;
+		public:
+			MappedFile() = default;
+			MappedFile(const char* path) {
+				const int fd = ::open(path, O_RDONLY);
+				if(fd < 0)
+					return;
+				struct stat st;
+				if(::fstat(fd, &st) == 0 && st.st_size > 0) {
+					void* p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+					if(p != MAP_FAILED) {
+						_ptr = p;
+						_size = st.st_size;
+					}
+				}
+				::close(fd);
+			}
+			MappedFile(const MappedFile&) = delete;
+			MappedFile(MappedFile&& m) noexcept:
+				_ptr(m._ptr),
+				_size(m._size)
+			{
+				m._ptr = nullptr;
+				m._size = 0;
+			}
+			MappedFile& operator = (MappedFile&& m) noexcept {
+				this->~MappedFile();
+				new(this) MappedFile(std::move(m));
+				return *this;
+			}
+			~MappedFile() {
+				if(_ptr)
+					::munmap(_ptr, _size);
+			}
+			explicit operator bool () const noexcept {
+				return _ptr != nullptr;
+			}
+			const void* data() const noexcept { return _ptr; }
+			std::size_t size() const noexcept { return _size; }
+
+			template <class T>
+			VecView<T> asVec() const {
+				return VecView<T>(_ptr, _size);
+			}
+			template <class T, class Id=uint_fast32_t>
+			ListView<T,Id> asList() const {
+				return ListView<T,Id>(_ptr, _size);
+			}
+	};
+	#endif
+}
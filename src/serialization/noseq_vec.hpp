@@ -8,8 +8,24 @@ namespace spi {
 		using base_t = typename noseq_vec<T,AL>::base_t;
 		ar(cereal::base_class<base_t>(&ns));
 	}
+	template <class Ar, class T, std::size_t N, class AL>
+	void save(Ar& ar, const noseq_small_vec<T,N,AL>& ns) {
+		ar(cereal::make_size_tag(static_cast<cereal::size_type>(ns.size())));
+		for(auto& v : ns)
+			ar(v);
+	}
+	template <class Ar, class T, std::size_t N, class AL>
+	void load(Ar& ar, noseq_small_vec<T,N,AL>& ns) {
+		cereal::size_type size;
+		ar(cereal::make_size_tag(size));
+		ns.resize(static_cast<std::size_t>(size));
+		for(auto& v : ns)
+			ar(v);
+	}
 }
 namespace cereal {
 	template <class Ar, class T, class AL>
 	struct specialize<Ar, spi::noseq_vec<T,AL>, cereal::specialization::non_member_serialize> {};
+	template <class Ar, class T, std::size_t N, class AL>
+	struct specialize<Ar, spi::noseq_small_vec<T,N,AL>, cereal::specialization::non_member_load_save> {};
 }
@@ -0,0 +1,241 @@
+#pragma once
+#include "flyweight.hpp"
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <array>
+
+namespace spi {
+	namespace string_table {
+		//! アリーナ上の文字列の先頭に置くヘッダ(直後に文字列本体とNUL終端が続く)
+		struct Header {
+			std::size_t		hash_value;
+			uint32_t		length;
+
+			const char* data() const noexcept {
+				return reinterpret_cast<const char*>(this + 1);
+			}
+		};
+	}
+	//! StringTableに登録された文字列を指すハンドル
+	/*!
+		同じテーブルに登録された文字列同士の比較はポインタ比較のみ
+		文字列の実体はテーブルが破棄されるまで有効
+	*/
+	class Symbol {
+		private:
+			template <class>
+			friend class StringTable;
+			using Header = string_table::Header;
+			const Header*	_header = nullptr;
+
+			Symbol(const Header* h) noexcept:
+				_header(h)
+			{}
+		public:
+			Symbol() = default;
+			std::string_view view() const noexcept {
+				if(!_header)
+					return {};
+				return {_header->data(), _header->length};
+			}
+			//! NUL終端された文字列
+			const char* c_str() const noexcept {
+				return _header ? _header->data() : "";
+			}
+			std::size_t size() const noexcept {
+				return _header ? _header->length : 0;
+			}
+			bool empty() const noexcept {
+				return size() == 0;
+			}
+			//! 登録時に計算したハッシュ値(std::hash<std::string_view>と同じ)
+			std::size_t hash() const noexcept {
+				return _header ? _header->hash_value : 0;
+			}
+			operator std::string_view () const noexcept {
+				return view();
+			}
+			explicit operator bool () const noexcept {
+				return _header != nullptr;
+			}
+			bool operator == (const Symbol& s) const noexcept {
+				return _header == s._header;
+			}
+			bool operator != (const Symbol& s) const noexcept {
+				return _header != s._header;
+			}
+			//! 辞書順の比較
+			bool operator < (const Symbol& s) const noexcept {
+				return view() < s.view();
+			}
+	};
+	//! 文字列を大きなページに詰めて格納する文字列専用のFlyweight
+	/*!
+		文字列毎の確保は行わず、ハッシュ値と長さを文字列と一緒にページへ書き込む
+		登録した文字列は削除できない(テーブルの破棄時にまとめて解放)
+		\tparam Policy	flyweight::Singleなら単一スレッド専用、flyweight::Sharded<N>ならテーブルをハッシュ値でN個に分割し、それぞれmutexで保護する
+						(Symbolからの文字列参照はロックしない)
+	*/
+	template <class Policy=flyweight::Single>
+	class StringTable {
+		private:
+			using Header = string_table::Header;
+			using Mutex = typename Policy::Mutex;
+			constexpr static std::size_t NShard = Policy::NShard,
+										Align = alignof(Header);
+			struct Page {
+				std::unique_ptr<char[]>	buff;
+				std::size_t				size,
+										used;
+			};
+			using PageV = std::vector<Page>;
+			//! オープンアドレス法のハッシュテーブル
+			using Slots = std::vector<const Header*>;
+			// 隣のシャードとキャッシュラインを共有しないようにする
+			struct alignas(64) Shard {
+				mutable Mutex	mutex;
+				PageV			page;
+				Slots			slot = Slots(64, nullptr);
+				std::size_t		nString = 0,
+								nByte = 0;
+
+				//! 文字列を格納する領域を確保
+				char* alloc(const std::size_t n, const std::size_t pageSize) {
+					const std::size_t sz = (n + Align-1) / Align * Align;
+					// 大きな文字列は専用のページに置き、書き込み中のページ(末尾)は使い続ける
+					if(sz > pageSize/4) {
+						Page p{std::unique_ptr<char[]>(new char[sz]), sz, sz};
+						char* ret = p.buff.get();
+						page.insert(page.empty() ? page.end() : page.end()-1, std::move(p));
+						return ret;
+					}
+					if(page.empty() || page.back().size - page.back().used < sz)
+						page.push_back(Page{std::unique_ptr<char[]>(new char[pageSize]), pageSize, 0});
+					auto& p = page.back();
+					char* ret = p.buff.get() + p.used;
+					p.used += sz;
+					return ret;
+				}
+				std::size_t slotIndex(const std::size_t hash) const noexcept {
+					return hash & (slot.size()-1);
+				}
+				//! 文字列を探し、見つからなければ空きスロットの位置を返す
+				std::size_t probe(const std::string_view s, const std::size_t hash) const noexcept {
+					std::size_t idx = slotIndex(hash);
+					for(;;) {
+						const Header* h = slot[idx];
+						if(!h ||
+							(h->hash_value == hash &&
+							h->length == s.size() &&
+							(s.empty() || std::memcmp(h->data(), s.data(), s.size()) == 0)))
+							return idx;
+						idx = (idx+1) & (slot.size()-1);
+					}
+				}
+				void rehash(const std::size_t n) {
+					Slots tmp(n, nullptr);
+					slot.swap(tmp);
+					for(auto* h : tmp) {
+						if(h) {
+							std::size_t idx = slotIndex(h->hash_value);
+							while(slot[idx])
+								idx = (idx+1) & (slot.size()-1);
+							slot[idx] = h;
+						}
+					}
+				}
+			};
+			using ShardA = std::array<Shard, NShard>;
+
+			std::size_t		_pageSize;
+			ShardA			_shard;
+
+			static std::size_t _Hash(const std::string_view s) noexcept {
+				return std::hash<std::string_view>()(s);
+			}
+			Shard& _getShard(const std::size_t hash) noexcept {
+				return _shard[flyweight::detail::ShardIndex<NShard>(hash)];
+			}
+			//! 全シャードの値をロックを取りながら集計
+			template <class F>
+			std::size_t _sum(const F& f) const {
+				std::size_t ret = 0;
+				for(auto& sh : _shard) {
+					std::lock_guard lk(sh.mutex);
+					ret += f(sh);
+				}
+				return ret;
+			}
+
+		public:
+			//! \param[in] pageSize	1ページあたりのバイト数
+			StringTable(const std::size_t pageSize = 64*1024):
+				_pageSize(pageSize)
+			{}
+			StringTable(const StringTable&) = delete;
+			StringTable& operator = (const StringTable&) = delete;
+
+			//! 文字列を登録してハンドルを返す(登録済みなら既存のハンドル)
+			/*! 長さが32bitに収まらない文字列は例外を送出する */
+			Symbol intern(const std::string_view s) {
+				Assert(s.size() <= std::numeric_limits<uint32_t>::max(), "too long string");
+				const std::size_t hash = _Hash(s);
+				auto& sh = _getShard(hash);
+				std::lock_guard lk(sh.mutex);
+				std::size_t idx = sh.probe(s, hash);
+				if(sh.slot[idx])
+					return Symbol(sh.slot[idx]);
+				// 負荷率を1/2以下に保つ
+				if((sh.nString+1)*2 > sh.slot.size()) {
+					sh.rehash(sh.slot.size()*2);
+					idx = sh.probe(s, hash);
+				}
+				char* p = sh.alloc(sizeof(Header) + s.size() + 1, _pageSize);
+				auto* h = new(p) Header{hash, uint32_t(s.size())};
+				char* dst = p + sizeof(Header);
+				if(!s.empty())
+					std::memcpy(dst, s.data(), s.size());
+				dst[s.size()] = '\0';
+				sh.slot[idx] = h;
+				++sh.nString;
+				sh.nByte += s.size();
+				return Symbol(h);
+			}
+			//! 登録済みの文字列を探す(無ければ空のハンドル)
+			Symbol find(const std::string_view s) {
+				const std::size_t hash = _Hash(s);
+				auto& sh = _getShard(hash);
+				std::lock_guard lk(sh.mutex);
+				return Symbol(sh.slot[sh.probe(s, hash)]);
+			}
+			//! 登録されている文字列の数
+			std::size_t size() const {
+				return _sum([](const Shard& sh){ return sh.nString; });
+			}
+			//! 登録されている文字列の合計バイト数(ヘッダと終端を除く)
+			std::size_t stringBytes() const {
+				return _sum([](const Shard& sh){ return sh.nByte; });
+			}
+			//! 確保したページの合計バイト数
+			std::size_t reservedBytes() const {
+				return _sum([](const Shard& sh){
+					std::size_t ret = 0;
+					for(auto& p : sh.page)
+						ret += p.size;
+					return ret;
+				});
+			}
+	};
+}
+namespace std {
+	template <>
+	struct hash<spi::Symbol> {
+		std::size_t operator()(const spi::Symbol& s) const noexcept {
+			return s.hash();
+		}
+	};
+}
@@ -3,6 +3,8 @@
 #include "../flyweight_item.hpp"
 #include "lubee/src/check_serialization.hpp"
 #include "../serialization/flyweight_item.hpp"
+#include "../flyweight_id.hpp"
+#include <thread>
 
 namespace spi {
 	namespace test {
@@ -77,12 +79,273 @@ namespace spi {
 					set1.erase(itr1);
 					ASSERT_EQ(set0.size(), set1.size());
 				}
+				// テーブルには参照が残っている値だけがある
+				ASSERT_EQ(set1.size(), this->_set.size());
 				if(mt.template getUniform<int>({0, 100}) == 0) {
 					this->_set.gc();
 				}
 				ASSERT_EQ(set0.size(), set1.size());
 			}
 		}
+		TYPED_TEST(Flyweight, Release) {
+			const auto value = this->template makeRV<TypeParam>();
+			{
+				const auto sp = this->_set.make(TypeParam(value));
+				ASSERT_EQ(1, this->_set.size());
+				ASSERT_EQ(sp, this->_set.make(TypeParam(value)));
+			}
+			// 参照が無くなった時点でエントリは削除される
+			ASSERT_EQ(0, this->_set.size());
+			ASSERT_EQ(0, this->_set.gc());
+			const auto sp = this->_set.make(TypeParam(value));
+			ASSERT_EQ(value, Deref_MoveOnly(*sp));
+			ASSERT_EQ(1, this->_set.size());
+			{
+				// テーブルが先に破棄されても値は参照できる
+				auto set = std::make_unique<typename TestFixture::set_t>();
+				const auto sp2 = set->make(TypeParam(value));
+				set.reset();
+				ASSERT_EQ(value, Deref_MoveOnly(*sp2));
+			}
+		}
+		TYPED_TEST(Flyweight, Stats) {
+			auto& set = this->_set;
+			std::vector<typename TestFixture::sp_t> spv;
+			std::unordered_set<uint32_t> vs;
+			const int N = this->mt().template getUniform<int>({1, 128});
+			for(int i=0 ; i<N ; i++) {
+				const auto value = this->template makeRV<TypeParam>();
+				vs.emplace(Deref_MoveOnly(TypeParam(value)));
+				spv.emplace_back(set.make(TypeParam(value)));
+			}
+			const auto st0 = set.stats();
+			ASSERT_EQ(vs.size(), st0.nValue);
+			ASSERT_EQ(vs.size(), st0.nMiss);
+			ASSERT_EQ(N - vs.size(), st0.nHit);
+			// 走査しない場合は集計されない
+			ASSERT_EQ(0, st0.nReference);
+
+			const auto st1 = set.stats(true);
+			ASSERT_EQ(st0.nValue, st1.nValue);
+			ASSERT_EQ(std::size_t(N), st1.nReference);
+			ASSERT_EQ(0, st1.nExpired);
+			ASSERT_EQ((N - vs.size()) * sizeof(TypeParam), st1.bytesSaved);
+			ASSERT_LE(st1.nCollision, st1.nValue);
+			ASSERT_GE(st1.maxBucketSize, 1);
+			ASSERT_GT(st1.nBucket, 0);
+			ASSERT_NEAR(double(st1.nValue)/st1.nBucket, st1.loadFactor(), 1e-9);
+
+			// 名前はキー毎に異なり、プレフィックスが付く
+			const flyweight::StatsKey key0("Fw0"),
+										key1("Fw1");
+			std::vector<std::string> name0;
+			st1.iterate(key0, [&name0](const char* name, double){
+				ASSERT_EQ(0, std::string_view(name).find("Fw0."));
+				name0.emplace_back(name);
+			});
+			ASSERT_FALSE(name0.empty());
+			ASSERT_EQ(name0.size(), std::unordered_set<std::string>(name0.begin(), name0.end()).size());
+			std::size_t nItem = 0;
+			st1.named(key1).iterate([&](const char* name, double){
+				ASSERT_EQ("Fw1" + name0[nItem].substr(3), name);
+				++nItem;
+			});
+			ASSERT_EQ(name0.size(), nItem);
+
+			spv.clear();
+			const auto st2 = set.stats(true);
+			ASSERT_EQ(0, st2.nValue);
+			ASSERT_EQ(0, st2.nReference);
+		}
+		namespace {
+			//! 構築回数を数える文字列
+			struct CountedStr {
+				inline static int s_nConstruct = 0;
+				std::string	str;
+				CountedStr(const std::string_view s):
+					str(s)
+				{
+					++s_nConstruct;
+				}
+			};
+			struct CountedHash {
+				using is_transparent = void;
+				std::size_t operator()(const CountedStr& s) const noexcept {
+					return flyweight::StringHash()(s.str);
+				}
+				std::size_t operator()(const std::string_view s) const noexcept {
+					return flyweight::StringHash()(s);
+				}
+			};
+			struct CountedEq {
+				using is_transparent = void;
+				bool operator()(const CountedStr& s0, const CountedStr& s1) const noexcept {
+					return s0.str == s1.str;
+				}
+				bool operator()(const CountedStr& s0, const std::string_view s1) const noexcept {
+					return s0.str == s1;
+				}
+			};
+		}
+		TEST(FlyweightHetero, Make) {
+			// 既にある値はvalue_tを構築せずに見つかる
+			::spi::Flyweight<CountedStr, CountedHash, CountedEq> set;
+			CountedStr::s_nConstruct = 0;
+			const auto sp0 = set.make(std::string_view("hello"));
+			ASSERT_EQ(1, CountedStr::s_nConstruct);
+			const auto sp1 = set.make(std::string_view("hello"));
+			ASSERT_EQ(1, CountedStr::s_nConstruct);
+			ASSERT_EQ(sp0, sp1);
+			const auto sp2 = set.make(std::string_view("world"));
+			ASSERT_EQ(2, CountedStr::s_nConstruct);
+			ASSERT_NE(sp0, sp2);
+			ASSERT_EQ(2, set.size());
+		}
+		TEST(FlyweightHetero, String) {
+			using fw_t = ::spi::FlyweightItem<std::string, flyweight::StringHash>;
+			const std::string str("hello");
+			const fw_t fw0(str),
+						fw1(std::string_view("hello")),
+						fw2("hello"),
+						fw3(str.c_str()),
+						fw4("world");
+			ASSERT_EQ(fw0, fw1);
+			ASSERT_EQ(fw0, fw2);
+			ASSERT_EQ(fw0, fw3);
+			ASSERT_NE(fw0, fw4);
+			ASSERT_EQ(str, *fw1);
+		}
+		TYPED_TEST(Flyweight, Id) {
+			using id_t = ::spi::FlyweightId<TypeParam>;
+			static_assert(sizeof(id_t) == 4);
+			static_assert(std::is_trivially_copyable_v<id_t>);
+			const auto value = this->template makeRV<TypeParam>();
+			const id_t f0(TypeParam{value}),
+						f1(TypeParam{value}),
+						f2(TypeParam{MakeDifferentValue(value)});
+			ASSERT_EQ(f0, f1);
+			ASSERT_EQ(f0.id(), f1.id());
+			ASSERT_EQ(f0.get(), f1.get());
+			ASSERT_NE(f0, f2);
+			ASSERT_EQ(value, Deref_MoveOnly(*f0));
+			const id_t fnull;
+			ASSERT_FALSE(fnull);
+			ASSERT_TRUE(f0);
+			ASSERT_EQ(std::hash<id_t>()(f0), f0.id());
+		}
+		TYPED_TEST(Flyweight, IdRefCount) {
+			// 参照カウント有りの場合は、参照が無くなった値が解放される
+			using id_t = ::spi::FlyweightId<TypeParam, std::hash<TypeParam>, std::equal_to<>, true>;
+			static_assert(sizeof(id_t) == 4);
+			auto& mt = this->mt();
+			std::unordered_map<uint32_t, std::vector<id_t>> ref;
+			std::size_t N = 1024;
+			while(N-- != 0) {
+				const auto value = this->template makeRV<TypeParam>();
+				const auto rv = Deref_MoveOnly(value);
+				auto& v = ref[rv];
+				if(v.empty() || mt.template getUniform<int>({0, 2}) != 0) {
+					if(!v.empty() && mt.template getUniform<int>({0, 1}) == 0)
+						v.push_back(v.front());
+					else
+						v.emplace_back(TypeParam(value));
+					ASSERT_EQ(rv, Deref_MoveOnly(*v.back()));
+					ASSERT_EQ(v.front(), v.back());
+				} else {
+					v.pop_back();
+					if(v.empty())
+						ref.erase(rv);
+				}
+				ASSERT_EQ(ref.size(), id_t::NumValue());
+			}
+			ref.clear();
+			ASSERT_EQ(0, id_t::NumValue());
+		}
+		struct FlyweightConcurrent : Random {};
+		TEST_F(FlyweightConcurrent, Sharded) {
+			using set_t = ::spi::Flyweight<uint32_t, std::hash<uint32_t>, std::equal_to<>, flyweight::Sharded<8>>;
+			using sp_t = typename set_t::SP;
+			set_t set;
+			const int nThread = mt().getUniform<int>({2, 4});
+			const uint32_t nValue = 64;
+			// 各スレッドが同じ範囲の値を生成、解放し合う
+			std::vector<std::vector<sp_t>> hold(nThread);
+			std::vector<std::thread> th;
+			for(int t=0 ; t<nThread ; t++) {
+				th.emplace_back([&set, &hold, t, nValue](){
+					auto& h = hold[t];
+					h.resize(nValue);
+					for(uint32_t i=0 ; i<4096 ; i++) {
+						const uint32_t v = (i*7 + t) % nValue;
+						if(i % 3 == 0)
+							h[v].reset();
+						else {
+							h[v] = set.make(v);
+							ASSERT_EQ(v, *h[v]);
+						}
+					}
+				});
+			}
+			for(auto& t : th)
+				t.join();
+			// 同じ値は同じポインタを共有し、テーブルには参照が残っている値だけがある
+			std::unordered_map<uint32_t, const uint32_t*> ptr;
+			for(auto& h : hold) {
+				for(auto& sp : h) {
+					if(sp) {
+						const auto [itr, added] = ptr.emplace(*sp, sp.get());
+						ASSERT_EQ(itr->second, sp.get());
+					}
+				}
+			}
+			ASSERT_EQ(ptr.size(), set.size());
+			hold.clear();
+			ASSERT_EQ(0, set.size());
+		}
+		TEST_F(FlyweightConcurrent, IdSharded) {
+			using id_t = ::spi::FlyweightId<uint32_t, std::hash<uint32_t>, std::equal_to<>, true, flyweight::Sharded<8>>;
+			static_assert(sizeof(id_t) == 4);
+			const int nThread = mt().getUniform<int>({2, 4});
+			const uint32_t nValue = 64;
+			// 各スレッドが同じ範囲の値を確保、解放し合う
+			std::vector<std::vector<id_t>> hold(nThread);
+			std::vector<std::thread> th;
+			for(int t=0 ; t<nThread ; t++) {
+				th.emplace_back([&hold, t, nValue](){
+					auto& h = hold[t];
+					h.resize(nValue);
+					for(uint32_t i=0 ; i<4096 ; i++) {
+						const uint32_t v = (i*7 + t) % nValue;
+						if(i % 3 == 0)
+							h[v] = id_t();
+						else {
+							h[v] = id_t(v);
+							ASSERT_EQ(v, *h[v]);
+						}
+						// コピーでも参照カウントが増減する
+						if(h[v] && i % 5 == 0) {
+							const id_t tmp(h[v]);
+							ASSERT_EQ(h[v], tmp);
+						}
+					}
+				});
+			}
+			for(auto& t : th)
+				t.join();
+			// 同じ値は同じIDを共有し、テーブルには参照が残っている値だけがある
+			std::unordered_map<uint32_t, uint32_t> ids;
+			for(auto& h : hold) {
+				for(auto& f : h) {
+					if(f) {
+						const auto [itr, added] = ids.emplace(*f, f.id());
+						ASSERT_EQ(itr->second, f.id());
+					}
+				}
+			}
+			ASSERT_EQ(ids.size(), id_t::NumValue());
+			hold.clear();
+			ASSERT_EQ(0, id_t::NumValue());
+		}
 		template <class T>
 		using FlyweightItem = Flyweight<T>;
 		TYPED_TEST_SUITE(FlyweightItem, FwT);
@@ -105,6 +368,8 @@ namespace spi {
 			#undef Check_OP
 
 			if constexpr (std::is_copy_constructible_v<TypeParam>) {
+				// 他のアイテムと共有している場合はコピーを書き換える
+				const fw_t fw_other(fw_value);
 				std::decay_t<decltype(value)> value2;
 				{
 					auto ref = fw_value.ref();
@@ -114,6 +379,56 @@ namespace spi {
 					ASSERT_NE(Deref_MoveOnly(*fw_value), *ref);
 				}
 				ASSERT_EQ(value2, Deref_MoveOnly(*fw_value));
+				ASSERT_EQ(value, Deref_MoveOnly(*fw_other));
+			} else {
+				// コピーできない値を共有している場合は書き換えられない
+				const fw_t fw_other(fw_value);
+				const auto* ptr = fw_value.get();
+				ASSERT_ANY_THROW(fw_value.ref());
+				ASSERT_ANY_THROW(fw_value.modify([](auto&){}));
+				ASSERT_EQ(ptr, fw_value.get());
+				ASSERT_EQ(fw_other, fw_value);
+			}
+		}
+		TYPED_TEST(FlyweightItem, ModifyInPlace) {
+			const auto value = this->template makeRV<TypeParam>();
+			using fw_t = ::spi::FlyweightItem<TypeParam>;
+			fw_t fw(TypeParam{value});
+			const auto* ptr = fw.get();
+			const auto value2 = MakeDifferentValue(value);
+			// 参照が1つだけならコピーせずに直接書き換える(move-onlyな型でも可)
+			{
+				auto ref = fw.ref();
+				*ref = TypeParam(value2);
+				ASSERT_EQ(value2, Deref_MoveOnly(*fw));
+			}
+			ASSERT_EQ(ptr, fw.get());
+			ASSERT_EQ(value2, Deref_MoveOnly(*fw));
+			// 書き換え後の値で検索できる
+			{
+				const fw_t fw2(TypeParam{value2});
+				ASSERT_EQ(fw, fw2);
+				// 元の値は登録されていない
+				const fw_t fw3(TypeParam{value});
+				ASSERT_NE(ptr, fw3.get());
+			}
+			// 書き換えた結果が既存の値と同じなら、そちらを共有する
+			const fw_t fw_exist(TypeParam{value});
+			fw.modify([&value](auto& v){
+				v = TypeParam(MakeDifferentValue(value));
+				v = TypeParam(value);
+			});
+			ASSERT_EQ(fw_exist, fw);
+			ASSERT_EQ(fw_exist.get(), fw.get());
+		}
+		TEST(FlyweightItem, ModifySharded) {
+			using fw_t = ::spi::FlyweightItem<int, std::hash<int>, std::equal_to<>, flyweight::Sharded<4>>;
+			fw_t fw(0);
+			const auto* ptr = fw.get();
+			for(int i=1 ; i<=256 ; i++) {
+				fw.modify([i](int& v){ v = i; });
+				ASSERT_EQ(ptr, fw.get());
+				ASSERT_EQ(fw_t(i), fw);
 			}
 		}
 		TYPED_TEST(FlyweightItem, Hash) {
@@ -140,6 +455,51 @@ namespace spi {
 			lubee::CheckSerialization(fw,
 				[](const auto& f0, const auto& f1){ return *f0 == *f1; });
 		}
+		//! 値のテーブルとインデックスでシリアライズする配列
+		template <class FW>
+		struct FwTable {
+			std::vector<FW>	value;
+
+			template <class Ar>
+			void serialize(Ar& ar) {
+				ar(flyweight::AsTable(value));
+			}
+		};
+		TYPED_TEST(FlyweightItem, SerializationTable) {
+			using fw_t = ::spi::FlyweightItem<TypeParam>;
+			FwTable<fw_t> tbl;
+			// 同じ値を参照するアイテムと空のアイテムを混ぜる
+			const int N = this->mt().template getUniform<int>({1, 64});
+			for(int i=0 ; i<N ; i++) {
+				if(this->mt().template getUniform<int>({0, 7}) == 0)
+					tbl.value.emplace_back();
+				else
+					tbl.value.emplace_back(TypeParam(this->template makeRV<TypeParam>()));
+			}
+			lubee::CheckSerialization(tbl,
+				[](const auto& t0, const auto& t1){
+					if(t0.value.size() != t1.value.size())
+						return false;
+					for(std::size_t i=0 ; i<t0.value.size() ; i++) {
+						const auto &f0 = t0.value[i],
+									&f1 = t1.value[i];
+						if(static_cast<bool>(f0) != static_cast<bool>(f1))
+							return false;
+						if(f0 && !(*f0 == *f1))
+							return false;
+					}
+					return true;
+				});
+		}
+		TYPED_TEST(FlyweightItem, Sharded) {
+			using fw_t = ::spi::FlyweightItem<TypeParam, std::hash<TypeParam>, std::equal_to<>, flyweight::Sharded<4>>;
+			const auto value = this->template makeRV<TypeParam>();
+			const fw_t fw0(TypeParam{value}),
+						fw1(TypeParam{value});
+			ASSERT_EQ(fw0, fw1);
+			ASSERT_EQ(fw0.get(), fw1.get());
+			ASSERT_EQ(value, Deref_MoveOnly(*fw0));
+		}
 		TYPED_TEST(FlyweightItem, Null) {
 			const auto value = this->template makeRV<TypeParam>();
 			using fw_t = ::spi::FlyweightItem<TypeParam>;
@@ -150,5 +510,21 @@ namespace spi {
 			ASSERT_FALSE(fw_null);
 			ASSERT_TRUE(fw_val);
 		}
+		// 値以外の型からの構築はexplicitなので、暗黙に登録されたり比較が曖昧になったりしない
+		TEST(FlyweightConversion, Explicit) {
+			using vec_t = std::vector<int>;
+			static_assert(std::is_constructible_v<::spi::FlyweightItem<vec_t>, int>);
+			static_assert(!std::is_convertible_v<int, ::spi::FlyweightItem<vec_t>>);
+			static_assert(std::is_constructible_v<::spi::FlyweightId<std::string>, const char*>);
+			static_assert(!std::is_convertible_v<const char*, ::spi::FlyweightId<std::string>>);
+
+			const ::spi::FlyweightItem<std::string> fw(std::string("abc"));
+			ASSERT_TRUE(fw == "abc");
+			ASSERT_TRUE("abc" == fw);
+			ASSERT_FALSE(fw != "abc");
+			ASSERT_TRUE(fw < "abd");
+			const ::spi::FlyweightItem<std::string, flyweight::StringHash> fw2("abc");
+			ASSERT_TRUE(fw2 == "abc");
+		}
 	}
 }
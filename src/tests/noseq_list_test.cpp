@@ -2,7 +2,13 @@
 #include "lubee/src/random/string.hpp"
 #include "moveonly.hpp"
 #include "../serialization/noseq_list.hpp"
+#include "../serialization/noseq_snapshot.hpp"
 #include "lubee/src/check_serialization.hpp"
+#include <thread>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
 
 namespace spi {
 	namespace test {
@@ -144,5 +150,326 @@ namespace spi {
 			std::reverse(rplain.begin(), rplain.end());
 			ASSERT_EQ(plain, rplain);
 		}
+		TEST_F(NoseqList, Staging) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+
+			noseq_list<int> nl;
+			using Map = std::unordered_map<noseq_list<int>::id_t, int>;
+			Map map;
+			// 事前にいくつか要素を追加し、一部を削除しておく
+			{
+				int n = rdi({0, 64});
+				while(n-- != 0) {
+					const int val = rdi();
+					map.emplace(nl.add(val), val);
+				}
+				n = rdi({0, int(map.size())});
+				while(n-- != 0) {
+					const auto itr = map.begin();
+					nl.rem(itr->first);
+					map.erase(itr);
+				}
+			}
+			auto st = nl.makeStaging(rdi({1, 16}));
+			constexpr int NThread = 4;
+			std::vector<Map> result(NThread);
+			std::vector<int> nAdd(NThread);
+			for(auto& n : nAdd)
+				n = rdi({0, 256});
+			{
+				std::vector<std::thread> th;
+				for(int i=0 ; i<NThread ; i++) {
+					auto& buff = st.makeBuffer();
+					th.emplace_back([&buff, &res=result[i], n=nAdd[i], i](){
+						for(int j=0 ; j<n ; j++) {
+							const int val = i*1000 + j;
+							// 予約されたIDはバッファ内で重複しない
+							ASSERT_TRUE(res.emplace(buff.add(val), val).second);
+						}
+					});
+				}
+				for(auto& t : th)
+					t.join();
+			}
+			st.commit();
+			for(auto& r : result) {
+				for(auto& ent : r) {
+					// スレッド間でIDが重複しない
+					ASSERT_TRUE(map.emplace(ent).second);
+				}
+			}
+			ASSERT_EQ(map.size(), nl.size());
+			for(auto& ent : map) {
+				ASSERT_TRUE(nl.has(ent.first));
+				ASSERT_EQ(ent.second, nl.get(ent.first));
+			}
+			// commit後も通常の追加削除ができる
+			for(int i=0 ; i<32 ; i++) {
+				const int val = rdi();
+				map.emplace(nl.add(val), val);
+			}
+			while(!map.empty()) {
+				const auto itr = map.begin();
+				ASSERT_EQ(itr->second, nl.get(itr->first));
+				nl.rem(itr->first);
+				map.erase(itr);
+			}
+			ASSERT_TRUE(nl.empty());
+		}
+		TEST_F(NoseqList, Reorder) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+
+			noseq_t nl;
+			using raw_t = std::decay_t<decltype(std::declval<value_t>().get())>;
+			using Map = std::unordered_map<noseq_t::id_t, raw_t>;
+			Map map;
+			// 追加と削除を繰り返して順序をばらばらにする
+			int nOp = rdi({8, 256});
+			while(nOp-- != 0) {
+				if(map.empty() || rdi({0, 2}) != 0) {
+					const raw_t val = rdi();
+					map.emplace(nl.add(value_t(val)), val);
+				} else {
+					const auto itr = map.begin();
+					nl.rem(itr->first);
+					map.erase(itr);
+				}
+			}
+			const auto fnCheck = [&map, &nl](){
+				ASSERT_EQ(map.size(), nl.size());
+				for(auto& ent : map) {
+					ASSERT_TRUE(nl.has(ent.first));
+					ASSERT_EQ(ent.second, nl.get(ent.first).get());
+				}
+			};
+			// ソート後は値が昇順に並び、IDも有効なまま
+			nl.sortDense();
+			ASSERT_TRUE(std::is_sorted(nl.begin(), nl.end()));
+			fnCheck();
+
+			// 逆順に並べ替え
+			std::vector<std::size_t> perm(nl.size());
+			for(std::size_t i=0 ; i<perm.size() ; i++)
+				perm[i] = perm.size()-1-i;
+			nl.reorder(perm);
+			ASSERT_TRUE(std::is_sorted(nl.begin(), nl.end(), std::greater<>()));
+			fnCheck();
+
+			// 並べ替えの後も追加削除ができる
+			for(int i=0 ; i<16 ; i++) {
+				const raw_t val = rdi();
+				map.emplace(nl.add(value_t(val)), val);
+			}
+			while(map.size() > 8) {
+				const auto itr = map.begin();
+				nl.rem(itr->first);
+				map.erase(itr);
+			}
+			fnCheck();
+		}
+		TEST_F(NoseqList, Snapshot) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+
+			struct Pod {
+				int		a;
+				float	b;
+				bool operator == (const Pod& p) const noexcept {
+					return a == p.a && b == p.b;
+				}
+			};
+			using list_t = noseq_list<Pod>;
+			list_t nl;
+			std::vector<list_t::id_t> id;
+			int nOp = rdi({0, 256});
+			while(nOp-- != 0) {
+				if(id.empty() || rdi({0, 2}) != 0) {
+					const int v = rdi();
+					id.push_back(nl.add(Pod{v, float(v)*0.5f}));
+				} else {
+					const int idx = rdi({0, int(id.size())-1});
+					nl.rem(id[idx]);
+					id.erase(id.begin()+idx);
+				}
+			}
+			std::stringstream ss;
+			snapshot::Save(ss, nl);
+			const std::string buff = ss.str();
+			{
+				// ストリームからの復元
+				list_t nl2;
+				ASSERT_TRUE(snapshot::Load(ss, nl2));
+				ASSERT_EQ(nl, nl2);
+				// 復元後も追加削除ができる
+				for(auto i : id)
+					nl2.rem(i);
+				ASSERT_TRUE(nl2.empty());
+				nl2.add(Pod{1, 2.f});
+				ASSERT_EQ(1, nl2.size());
+			}
+			{
+				// 要素サイズや種類が異なるスナップショットは読み込めない
+				std::stringstream ss2(buff);
+				noseq_list<uint16_t> nl3;
+				ASSERT_FALSE(snapshot::Load(ss2, nl3));
+				noseq_vec<Pod> nv;
+				ss2.seekg(0);
+				ASSERT_FALSE(snapshot::Load(ss2, nv));
+			}
+			// ファイルに書き出してmmapで参照
+			const char* tmpDir = std::getenv("TMPDIR");
+			std::string path = std::string(tmpDir ? tmpDir : "/tmp") + "/spi_snapshot_XXXXXX";
+			{
+				const int fd = ::mkstemp(path.data());
+				ASSERT_LE(0, fd);
+				const auto nw = ::write(fd, buff.data(), buff.size());
+				::close(fd);
+				ASSERT_EQ(ssize_t(buff.size()), nw);
+			}
+			{
+				const snapshot::MappedFile mf(path.c_str());
+				ASSERT_TRUE(mf);
+				const auto view = mf.asList<Pod>();
+				ASSERT_TRUE(view);
+				ASSERT_EQ(nl.size(), view.size());
+				ASSERT_TRUE(std::equal(view.begin(), view.end(), nl.begin()));
+				for(auto i : id) {
+					ASSERT_TRUE(view.has(i));
+					ASSERT_EQ(nl.get(i), view.get(i));
+				}
+				for(std::size_t i=0 ; i<view.size() ; i++)
+					ASSERT_EQ(&nl.get(view.idAt(i)), &*(nl.begin()+i));
+				list_t nl4;
+				ASSERT_TRUE(view.copyTo(nl4));
+				ASSERT_EQ(nl, nl4);
+			}
+			// 未初期化のビューは何も持たない
+			ASSERT_FALSE(snapshot::ListView<Pod>().has(0));
+			{
+				// ヘッダやID表が壊れたスナップショットは読み込めない
+				const auto modify = [&buff](auto&& f) {
+					std::string ret = buff;
+					snapshot::Header h;
+					std::memcpy(&h, ret.data(), sizeof(h));
+					f(h, ret);
+					std::memcpy(ret.data(), &h, sizeof(h));
+					return ret;
+				};
+				const auto check = [](const std::string& b) {
+					std::stringstream ss(b);
+					list_t nl5;
+					ASSERT_FALSE(snapshot::Load(ss, nl5));
+					const snapshot::ListView<Pod> view(b.data(), b.size());
+					ASSERT_FALSE(view && view.copyTo(nl5));
+				};
+				using H = snapshot::Header;
+				using S = std::string;
+				// 巨大な要素数でも確保前に弾かれる
+				check(modify([](H& h, S&){ h.nValue = h.nId = ~uint64_t(0) / 2; }));
+				check(modify([](H& h, S&){ h.nFree += 1; }));
+				check(modify([](H& h, S&){ h.offIds = ~uint64_t(0) - 8; }));
+				check(modify([](H& h, S&){ h.offUid = h.offValue; }));
+				// 途中で切れている
+				check(buff.substr(0, buff.size()-1));
+				if(!nl.empty()) {
+					// ID表が範囲外の値を指している
+					check(modify([](H& h, S& b){
+						using ids_t = _noseq_list::IDS<list_t::id_t>;
+						ids_t ids;
+						std::memcpy(&ids, b.data() + h.offIds, sizeof(ids));
+						ids.type = ids_t::Type::Obj;
+						ids.value = h.nValue;
+						std::memcpy(b.data() + h.offIds, &ids, sizeof(ids));
+					}));
+				}
+			}
+			std::remove(path.c_str());
+		}
+		TEST_F(NoseqList, Delta) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+
+			using list_t = noseq_list<std::string>;
+			using Map = std::unordered_map<list_t::id_t, std::string>;
+			Map map;
+			list_t src;
+			for(int i=rdi({0,32}) ; i>0 ; i--) {
+				const auto val = std::to_string(rdi());
+				map.emplace(src.add(val), val);
+			}
+			// 差分の適用先
+			list_t dst(src);
+			src.setTracking(true);
+			ASSERT_FALSE(src.hasChange());
+
+			const auto selectRandomNode = [&map, &rdi]() {
+				auto itr = map.begin();
+				std::advance(itr, rdi({0, int(map.size())-1}));
+				return itr;
+			};
+			const auto fnCheck = [&map](const list_t& l) {
+				ASSERT_EQ(map.size(), l.size());
+				for(auto& ent : map) {
+					ASSERT_TRUE(l.has(ent.first));
+					ASSERT_EQ(ent.second, l.get(ent.first));
+				}
+			};
+			int nOp = rdi({8, 128});
+			while(nOp-- != 0) {
+				switch(rdi({0, 6})) {
+					case 0:
+					case 1: {
+						const auto val = std::to_string(rdi());
+						map.emplace(src.add(val), val);
+						break; }
+					case 2:
+						if(!map.empty()) {
+							const auto itr = selectRandomNode();
+							itr->second += 'x';
+							src.get(itr->first) = itr->second;
+						}
+						break;
+					case 3:
+					case 4:
+						if(!map.empty()) {
+							const auto itr = selectRandomNode();
+							src.rem(itr->first);
+							map.erase(itr);
+						}
+						break;
+					case 5:
+						src.sortDense();
+						break;
+					case 6:
+						if(rdi({0, 4}) == 0) {
+							src.clear();
+							map.clear();
+						}
+						break;
+				}
+				if(rdi({0, 3}) == 0) {
+					// 差分を反映すれば同じ内容になる
+					dst.applyDelta(src.makeDelta());
+					ASSERT_FALSE(src.hasChange());
+					fnCheck(src);
+					fnCheck(dst);
+					ASSERT_TRUE(std::equal(src.begin(), src.end(), dst.begin(), dst.end()));
+				}
+			}
+			dst.applyDelta(src.makeDelta());
+			fnCheck(dst);
+			// 反映後も同じIDで追加削除ができる
+			for(int i=0 ; i<8 ; i++) {
+				const auto val = std::to_string(i);
+				ASSERT_EQ(src.add(val), dst.add(val));
+			}
+			for(auto& ent : map) {
+				src.rem(ent.first);
+				dst.rem(ent.first);
+			}
+			ASSERT_TRUE(std::equal(src.begin(), src.end(), dst.begin(), dst.end()));
+		}
 	}
 }
@@ -0,0 +1,236 @@
+#include "test.hpp"
+#include "moveonly.hpp"
+#include "../noseq_table.hpp"
+#include <unordered_map>
+#include <stdexcept>
+
+namespace spi {
+	namespace test {
+		struct NoseqTable : Random {
+			using table_t = noseq_table<int, MoveOnly<double>, std::string>;
+			using id_t = table_t::id_t;
+
+			// 行の全ての列を、行毎に決まった値(キー)から作る
+			static void CheckRow(const table_t& tbl, const id_t id, const int key) {
+				ASSERT_TRUE(tbl.has(id));
+				const auto [c0, c1, c2] = tbl.getRow(id);
+				ASSERT_EQ(key, c0);
+				ASSERT_EQ(key * 0.5, c1.getValue());
+				ASSERT_EQ(std::to_string(key), c2);
+			}
+		};
+		TEST_F(NoseqTable, General) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+
+			// ID -> キー
+			std::unordered_map<id_t, int> key;
+			table_t tbl;
+			const int nRow = rdi({1, 256});
+			for(int i=0 ; i<nRow ; i++)
+				key.emplace(tbl.add(i, MoveOnly<double>(i * 0.5), std::to_string(i)), i);
+			ASSERT_EQ(std::size_t(nRow), tbl.size());
+
+			// ランダムに行を削除しても、残った行のIDと列の並びは崩れない
+			const int nRem = rdi({0, nRow});
+			for(int i=0 ; i<nRem ; i++) {
+				auto itr = key.begin();
+				std::advance(itr, rdi({0, int(key.size())-1}));
+				tbl.rem(itr->first);
+				ASSERT_FALSE(tbl.has(itr->first));
+				key.erase(itr);
+			}
+			ASSERT_EQ(key.size(), tbl.size());
+			for(auto& k : key)
+				CheckRow(tbl, k.first, k.second);
+
+			// 列を直接走査しても行が揃っている
+			const int* c0 = tbl.column<0>();
+			const auto* c1 = tbl.column<1>();
+			const auto* c2 = tbl.column<2>();
+			for(std::size_t i=0 ; i<tbl.size() ; i++) {
+				const int k = key.at(tbl.idAt(i));
+				ASSERT_EQ(k, c0[i]);
+				ASSERT_EQ(k * 0.5, c1[i].getValue());
+				ASSERT_EQ(std::to_string(k), c2[i]);
+			}
+
+			// getRowで書き換えた値が各列に反映される
+			if(!key.empty()) {
+				auto& k = *key.begin();
+				auto [r0, r1, r2] = tbl.getRow(k.first);
+				k.second += nRow;
+				r0 = k.second;
+				r1 = MoveOnly<double>(k.second * 0.5);
+				r2 = std::to_string(k.second);
+				CheckRow(tbl, k.first, k.second);
+			}
+		}
+		TEST_F(NoseqTable, IdReuse) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+
+			table_t tbl;
+			const int nRow = rdi({2, 64});
+			std::vector<id_t> ids;
+			for(int i=0 ; i<nRow ; i++)
+				ids.push_back(tbl.add(i, MoveOnly<double>(i * 0.5), std::to_string(i)));
+			// 削除したIDは後に削除したものから再利用される
+			std::vector<id_t> remd;
+			const int nRem = rdi({1, nRow});
+			for(int i=0 ; i<nRem ; i++) {
+				const auto itr = ids.begin() + rdi({0, int(ids.size())-1});
+				remd.push_back(*itr);
+				tbl.rem(*itr);
+				ids.erase(itr);
+			}
+			while(!remd.empty()) {
+				const int k = rdi();
+				const id_t id = tbl.add(k, MoveOnly<double>(k * 0.5), std::to_string(k));
+				ASSERT_EQ(remd.back(), id);
+				remd.pop_back();
+				CheckRow(tbl, id, k);
+			}
+			// 空きが無くなれば新しいIDを割り当てる
+			const id_t id = tbl.add(0, MoveOnly<double>(0), "0");
+			ASSERT_EQ(id_t(nRow), id);
+			tbl.clear();
+			ASSERT_TRUE(tbl.empty());
+			ASSERT_FALSE(tbl.has(id));
+		}
+		namespace {
+			// 破棄時(上書き時)に同じテーブルの別の行を削除する
+			struct RemOther {
+				using table_t = noseq_table<RemOther, int>;
+				table_t*	table = nullptr;
+				table_t::id_t	target = 0;
+
+				RemOther() = default;
+				RemOther(table_t* t, const table_t::id_t id):
+					table(t), target(id)
+				{}
+				RemOther(RemOther&& r) noexcept:
+					table(r.table), target(r.target)
+				{
+					r.table = nullptr;
+				}
+				// 上書きされる値も破棄と同じく扱う
+				RemOther& operator = (RemOther&& r) {
+					_release();
+					table = r.table;
+					target = r.target;
+					r.table = nullptr;
+					return *this;
+				}
+				~RemOther() {
+					_release();
+				}
+				void _release() {
+					if(table && table->has(target))
+						table->rem(target);
+					table = nullptr;
+				}
+			};
+		}
+		// 削除処理中に呼ばれた削除は後回しにされる
+		TEST_F(NoseqTable, RemoveInDestructor) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+
+			using table_t = RemOther::table_t;
+			table_t tbl;
+			// 各行は次の行を道連れにする
+			const int nRow = rdi({2, 32});
+			for(int i=0 ; i<nRow ; i++)
+				tbl.add(RemOther(&tbl, i+1), i);
+			const int first = rdi({0, nRow-1});
+			tbl.rem(first);
+			ASSERT_EQ(std::size_t(first), tbl.size());
+			for(int i=0 ; i<first ; i++) {
+				ASSERT_TRUE(tbl.has(i));
+				ASSERT_EQ(i, tbl.get<1>(i));
+			}
+			// 残りの行の連鎖を切ってから破棄する
+			for(std::size_t i=0 ; i<tbl.size() ; i++)
+				tbl.column<0>()[i].table = nullptr;
+		}
+		namespace {
+			//! フラグが立っていると構築時に例外を投げる
+			struct ThrowCtor {
+				static bool s_throw;
+				int	value;
+				ThrowCtor(const int v):
+					value(v)
+				{
+					if(s_throw)
+						throw std::runtime_error("ThrowCtor");
+				}
+			};
+			bool ThrowCtor::s_throw = false;
+		}
+		// 列の構築で例外が出たら、追加済みの列を戻す
+		TEST_F(NoseqTable, AddException) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+
+			using table_t = noseq_table<std::string, ThrowCtor, int>;
+			table_t tbl;
+			const int nRow = rdi({0, 32});
+			std::vector<table_t::id_t> ids;
+			for(int i=0 ; i<nRow ; i++)
+				ids.push_back(tbl.add(std::to_string(i), i, i));
+			// 空きIDがある場合と無い場合の両方を試す
+			if(nRow > 0 && rdi({0, 1}) == 0) {
+				tbl.rem(ids.back());
+				ids.pop_back();
+			}
+			const std::size_t size = tbl.size();
+			ThrowCtor::s_throw = true;
+			ASSERT_THROW(tbl.add(std::string("x"), 0, 0), std::runtime_error);
+			ThrowCtor::s_throw = false;
+			ASSERT_EQ(size, tbl.size());
+			// 以降も全ての列が揃っている
+			const auto id = tbl.add(std::string("y"), -1, -1);
+			ASSERT_EQ(size+1, tbl.size());
+			ASSERT_EQ("y", tbl.get<0>(id));
+			ASSERT_EQ(-1, tbl.get<1>(id).value);
+			ASSERT_EQ(-1, tbl.get<2>(id));
+			for(std::size_t i=0 ; i<tbl.size() ; i++) {
+				const int v = tbl.column<2>()[i];
+				ASSERT_EQ(v, tbl.column<1>()[i].value);
+				ASSERT_EQ(v < 0 ? "y" : std::to_string(v), tbl.column<0>()[i]);
+			}
+		}
+		namespace {
+			int g_nAlloc = 0;
+			template <class T>
+			struct CountAlloc : std::allocator<T> {
+				template <class T2>
+				struct rebind {
+					using other = CountAlloc<T2>;
+				};
+				CountAlloc() = default;
+				template <class T2>
+				CountAlloc(const CountAlloc<T2>&) noexcept {}
+				T* allocate(const std::size_t n) {
+					++g_nAlloc;
+					return std::allocator<T>::allocate(n);
+				}
+			};
+		}
+		// アロケータとIDの型を指定できる
+		TEST_F(NoseqTable, TemplateParam) {
+			using table_t = basic_noseq_table<CountAlloc<void>, uint16_t, int, float>;
+			static_assert(std::is_same_v<table_t::id_t, uint16_t>);
+			g_nAlloc = 0;
+			table_t tbl;
+			const table_t::id_t id = tbl.add(1, 2.f);
+			ASSERT_LT(0, g_nAlloc);
+			const table_t& ctbl = tbl;
+			const auto [c0, c1] = ctbl.getRow(id);
+			static_assert(std::is_same_v<decltype(c0), const int&>);
+			ASSERT_EQ(1, c0);
+			ASSERT_EQ(2.f, c1);
+		}
+	}
+}
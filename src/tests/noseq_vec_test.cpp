@@ -2,6 +2,10 @@
 #include "moveonly.hpp"
 #include "lubee/src/random/string.hpp"
 #include "../serialization/noseq_vec.hpp"
+#include "../serialization/noseq_snapshot.hpp"
+#include <sstream>
+#include <map>
+#include <stdexcept>
 
 namespace spi {
 	namespace test {
@@ -66,5 +70,339 @@ namespace spi {
 			}
 			lubee::CheckSerialization(ns);
 		}
+		TEST_F(NoseqVec, Snapshot) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+
+			using noseq_t = noseq_vec<uint64_t>;
+			noseq_t ns;
+			int NElem = rdi({0, 256});
+			while(NElem-- != 0)
+				ns.emplace_back(rdi());
+
+			std::stringstream ss;
+			snapshot::Save(ss, ns);
+			noseq_t ns2;
+			ASSERT_TRUE(snapshot::Load(ss, ns2));
+			ASSERT_EQ(ns, ns2);
+
+			// メモリ上のスナップショットを直接参照
+			const std::string str = ss.str();
+			std::vector<uint64_t> buff(str.size()/sizeof(uint64_t) + 1);
+			std::memcpy(buff.data(), str.data(), str.size());
+			const snapshot::VecView<uint64_t> view(buff.data(), str.size());
+			ASSERT_TRUE(view);
+			ASSERT_EQ(ns.size(), view.size());
+			ASSERT_TRUE(std::equal(view.begin(), view.end(), ns.begin()));
+
+			// 要素のサイズが異なるとエラー
+			const snapshot::VecView<uint32_t> view2(buff.data(), str.size());
+			ASSERT_FALSE(view2);
+
+			// 要素数が壊れていれば、領域を確保する前にエラー
+			{
+				std::string str2 = str;
+				snapshot::Header h;
+				std::memcpy(&h, str2.data(), sizeof(h));
+				h.nValue = ~uint64_t(0) / sizeof(uint64_t);
+				std::memcpy(str2.data(), &h, sizeof(h));
+				std::stringstream ss2(str2);
+				ASSERT_FALSE(snapshot::Load(ss2, ns2));
+				ASSERT_FALSE(snapshot::VecView<uint64_t>(str2.data(), str2.size()));
+			}
+		}
+		TEST_F(NoseqVec, EraseMulti) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+
+			using value_t = MoveOnly<int>;
+			using noseq_t = noseq_vec<value_t>;
+			noseq_t ns;
+			std::multiset<int> set;
+			int NElem = rdi({0, 256});
+			while(NElem-- != 0) {
+				const int v = rdi({0, 100});
+				ns.emplace_back(v);
+				set.emplace(v);
+			}
+			const auto fnCheck = [&](){
+				ASSERT_EQ(set.size(), ns.size());
+				std::multiset<int> set2;
+				for(auto& v : ns)
+					set2.emplace(v.get());
+				ASSERT_EQ(set, set2);
+			};
+			// インデックス指定で削除
+			{
+				std::vector<std::size_t> idx;
+				for(std::size_t i=0 ; i<ns.size() ; i++) {
+					if(rdi({0, 2}) == 0) {
+						idx.push_back(i);
+						set.erase(set.find(ns[i].get()));
+					}
+				}
+				ns.erase_indices(idx);
+				fnCheck();
+			}
+			// 条件指定で削除
+			{
+				const int th = rdi({0, 100});
+				const auto pred = [th](const value_t& v){ return v.get() < th; };
+				std::size_t cnt = 0;
+				for(auto itr=set.begin() ; itr!=set.end() ; ) {
+					if(*itr < th) {
+						itr = set.erase(itr);
+						++cnt;
+					} else
+						++itr;
+				}
+				ASSERT_EQ(cnt, ns.erase_if(pred));
+				fnCheck();
+			}
+			// 全て削除
+			const std::size_t n = ns.size();
+			ASSERT_EQ(n, ns.erase_if([](auto&){ return true; }));
+			ASSERT_TRUE(ns.empty());
+		}
+		// 連続した削除対象の区間をまとめて埋める(trivially copyableな型とそれ以外)
+		TEST_F(NoseqVec, EraseIndicesRun) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+			const int n = rdi({0, 512});
+			noseq_vec<int> vi;
+			noseq_vec<std::string> vs;
+			for(int i=0 ; i<n ; i++) {
+				vi.push_back(i);
+				vs.push_back(std::to_string(i));
+			}
+			// ランダムな長さの区間を削除対象にする(末尾を含む場合もある)
+			std::vector<std::size_t> idx;
+			std::multiset<int> rest;
+			for(int i=0 ; i<n ; ) {
+				const int len = rdi({1, 16});
+				const bool rem = rdi({0, 1}) == 0;
+				for(int j=0 ; j<len && i<n ; j++, i++) {
+					if(rem)
+						idx.push_back(i);
+					else
+						rest.emplace(i);
+				}
+			}
+			vi.erase_indices(idx);
+			vs.erase_indices(idx);
+			ASSERT_EQ(rest, std::multiset<int>(vi.begin(), vi.end()));
+			std::multiset<int> rs;
+			for(auto& s : vs)
+				rs.emplace(std::stoi(s));
+			ASSERT_EQ(rest, rs);
+		}
+		template <class T>
+		struct NoseqSmallVec : Random {};
+		using SmallVecT = ::testing::Types<
+			noseq_small_vec<MoveOnly<std::string>, 1>,
+			noseq_small_vec<MoveOnly<std::string>, 8>,
+			noseq_small_vec<MoveOnly<int>, 4>
+		>;
+		TYPED_TEST_SUITE(NoseqSmallVec, SmallVecT);
+
+		TYPED_TEST(NoseqSmallVec, General) {
+			auto& mt = this->mt();
+			const auto rdi = mt.template getUniformF<int>();
+
+			using noseq_t = TypeParam;
+			using value_t = typename noseq_t::value_type;
+			using raw_t = std::decay_t<decltype(std::declval<value_t>().get())>;
+			const auto makeVal = [&rdi](){
+				if constexpr (std::is_same_v<raw_t, std::string>)
+					return lubee::random::GenAlphabetString(rdi, rdi({0,64}));
+				else
+					return rdi();
+			};
+			noseq_t ns;
+			std::multiset<raw_t> set;
+			const auto fnCheck = [&](const noseq_t& ns) {
+				ASSERT_EQ(set.size(), ns.size());
+				std::multiset<raw_t> set2;
+				for(auto& v : ns)
+					set2.emplace(v.get());
+				ASSERT_EQ(set, set2);
+			};
+			int NOp = rdi({1, 128});
+			while(NOp -- != 0) {
+				switch(rdi({0, 4})) {
+					case 0:
+					case 1: {
+						const raw_t val = makeVal();
+						set.emplace(val);
+						ns.emplace_back(val);
+						break; }
+					case 2:
+						if(!ns.empty()) {
+							const int idx = rdi({0, int(ns.size())-1});
+							set.erase(set.find(ns[idx].get()));
+							ns.erase(ns.begin()+idx);
+						}
+						break;
+					case 3: {
+						// ムーブしても内容は変わらない
+						noseq_t tmp(std::move(ns));
+						ASSERT_TRUE(ns.empty());
+						ns = std::move(tmp);
+						break; }
+					case 4:
+						if(rdi({0, 8}) == 0) {
+							ns.clear();
+							set.clear();
+						}
+						break;
+				}
+				fnCheck(ns);
+			}
+			// 一括削除
+			ns.erase_if([&set](const value_t& v){
+				if(v.get() < *set.begin())
+					return true;
+				return false;
+			});
+			fnCheck(ns);
+			std::vector<std::size_t> idx;
+			for(std::size_t i=0 ; i<ns.size() ; i+=2) {
+				idx.push_back(i);
+				set.erase(set.find(ns[i].get()));
+			}
+			ns.erase_indices(idx);
+			fnCheck(ns);
+		}
+		TEST(NoseqSmallVec, Inline) {
+			noseq_small_vec<int, 4> ns;
+			for(int i=0 ; i<4 ; i++) {
+				ns.push_back(i);
+				// 容量以下なら内部バッファに収まる
+				ASSERT_TRUE(ns.isInline());
+			}
+			ns.push_back(4);
+			ASSERT_FALSE(ns.isInline());
+			ASSERT_EQ(5, ns.size());
+			// コピーは要素数に応じた領域を使う
+			auto ns2 = ns;
+			ASSERT_EQ(ns, ns2);
+			ns2.erase(ns2.begin());
+			ASSERT_EQ(4, ns2.front());
+			ASSERT_EQ(4, ns2.size());
+			ASSERT_NE(ns, ns2);
+		}
+		namespace {
+			//! 確保したアロケータで解放されているかを確認する為の、IDを持つアロケータ
+			template <class T>
+			struct TaggedAlloc {
+				using value_type = T;
+				using propagate_on_container_move_assignment = std::false_type;
+				using is_always_equal = std::false_type;
+				int		tag;
+				static std::map<std::pair<const void*, int>, int>& Live() {
+					static std::map<std::pair<const void*, int>, int> live;
+					return live;
+				}
+
+				TaggedAlloc(const int t) noexcept: tag(t) {}
+				template <class T2>
+				TaggedAlloc(const TaggedAlloc<T2>& a) noexcept: tag(a.tag) {}
+				T* allocate(const std::size_t n) {
+					T* p = std::allocator<T>().allocate(n);
+					++Live()[{p, tag}];
+					return p;
+				}
+				void deallocate(T* p, const std::size_t n) {
+					// 別のアロケータで確保された領域を解放しようとしたら失敗
+					const auto itr = Live().find({p, tag});
+					ASSERT_NE(Live().end(), itr);
+					Live().erase(itr);
+					std::allocator<T>().deallocate(p, n);
+				}
+				bool operator == (const TaggedAlloc& a) const noexcept { return tag == a.tag; }
+				bool operator != (const TaggedAlloc& a) const noexcept { return tag != a.tag; }
+			};
+			//! 指定回数目のコピーで例外を投げる
+			struct ThrowCopy {
+				static int s_count;
+				int value;
+				ThrowCopy(const int v): value(v) {}
+				ThrowCopy(const ThrowCopy& t): value(t.value) {
+					if(--s_count == 0)
+						throw std::runtime_error("copy");
+				}
+				// noexceptでないので、領域拡張時はコピーが使われる
+				ThrowCopy(ThrowCopy&& t): value(t.value) {}
+				ThrowCopy& operator = (const ThrowCopy&) = default;
+			};
+			int ThrowCopy::s_count;
+		}
+		TEST(NoseqSmallVec, Allocator) {
+			using alc_t = TaggedAlloc<int>;
+			using noseq_t = noseq_small_vec<int, 2, alc_t>;
+			{
+				noseq_t a(alc_t(1)),
+						b(alc_t(2));
+				for(int i=0 ; i<8 ; i++) {
+					a.push_back(i);
+					b.push_back(-i);
+				}
+				// ムーブ構築ではアロケータも引き継ぐ
+				noseq_t c(std::move(a));
+				ASSERT_TRUE(a.empty());
+				ASSERT_EQ(8, c.size());
+				// アロケータが異なり、伝播もしないので要素毎にムーブされる
+				c = std::move(b);
+				ASSERT_EQ(8, c.size());
+				ASSERT_EQ(-7, c.back());
+				ASSERT_FALSE(c.isInline());
+			}
+			ASSERT_TRUE(alc_t::Live().empty());
+		}
+		TEST(NoseqSmallVec, GrowException) {
+			noseq_small_vec<ThrowCopy, 4> ns;
+			for(int i=0 ; i<4 ; i++)
+				ns.emplace_back(i);
+			// 拡張中に例外が投げられても元の要素はそのまま残る
+			ThrowCopy::s_count = 3;
+			ASSERT_THROW(ns.emplace_back(4), std::runtime_error);
+			ASSERT_EQ(4, ns.size());
+			ASSERT_TRUE(ns.isInline());
+			for(int i=0 ; i<4 ; i++)
+				ASSERT_EQ(i, ns[i].value);
+		}
+		// 容量一杯の時に自身の要素を追加しても、拡張前に値を読む
+		TEST(NoseqSmallVec, SelfReference) {
+			// SSOに収まらない長さにして、破棄済みの領域を読めばASanで検出できるようにする
+			const std::string s0(64, 'a'),
+								s1(64, 'b');
+			noseq_small_vec<std::string, 2> ns;
+			ns.push_back(s0);
+			ns.push_back(s1);
+			// 内部バッファ -> ヒープ
+			ns.push_back(ns[0]);
+			ASSERT_FALSE(ns.isInline());
+			ns.push_back(ns.back());
+			// ヒープ -> 更に大きなヒープ
+			ASSERT_EQ(ns.size(), ns.capacity());
+			ns.emplace_back(ns[1]);
+			ASSERT_EQ(5, ns.size());
+			const std::string expect[] = {s0, s1, s0, s0, s1};
+			for(int i=0 ; i<5 ; i++)
+				ASSERT_EQ(expect[i], ns[i]);
+		}
+		TEST_F(NoseqVec, SmallVecSerialization) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+			const auto makeVal = [&rdi](){ return lubee::random::GenAlphabetString(rdi, rdi({0,64})); };
+
+			using noseq_t = noseq_small_vec<std::string, 4>;
+			noseq_t ns;
+			int NElem = rdi({0, 16});
+			while(NElem-- != 0) {
+				ns.emplace_back(makeVal());
+			}
+			lubee::CheckSerialization(ns);
+		}
 	}
 }
@@ -1,6 +1,12 @@
 #include "test.hpp"
 #include "moveonly.hpp"
 #include "../pqueue.hpp"
+#include "../pqueue_heap.hpp"
+#include "../pqueue_concurrent.hpp"
+#include "../pqueue_radix.hpp"
+#include <map>
+#include <thread>
+#include <random>
 
 namespace spi {
 	namespace test {
@@ -73,5 +79,302 @@ namespace spi {
 			fnCheck();
 			EXPECT_EQ(512, q.size());
 		}
+		namespace {
+			// ヒープ版とソート済み配列版で取り出し順が一致するか
+			template <class Heap, class Insert>
+			void CheckHeapOrder(lubee::RandomMT& mt) {
+				const auto rdi = mt.getUniformF<int>();
+				pqueue<MyPair, std::deque, std::less<MyPair>, Insert> ref;
+				Heap heap;
+				int serial = 0;
+				int nOp = rdi({64, 1024});
+				while(nOp-- != 0) {
+					const int op = rdi({0, 3});
+					if(ref.empty() || op <= 1) {
+						// 同じ優先度が頻繁に出るよう値の範囲を狭くする
+						const MyPair p{rdi({0, 16}), serial++};
+						ref.push(p);
+						heap.push(p);
+					} else if(op == 2) {
+						// まとめて追加
+						std::vector<MyPair> v(rdi({0, 64}));
+						for(auto& p : v) {
+							p = MyPair{rdi({0, 16}), serial++};
+							ref.push(p);
+						}
+						heap.push_range(v.begin(), v.end());
+					} else {
+						ASSERT_EQ(ref.front().a, heap.front().a);
+						ASSERT_EQ(ref.front().b, heap.front().b);
+						ref.pop_front();
+						heap.pop_front();
+					}
+					ASSERT_EQ(ref.size(), heap.size());
+				}
+				while(!ref.empty()) {
+					MyPair p;
+					heap.pop_front(p);
+					ASSERT_EQ(ref.front().a, p.a);
+					ASSERT_EQ(ref.front().b, p.b);
+					ref.pop_front();
+				}
+				ASSERT_TRUE(heap.empty());
+			}
+		}
+		TEST_F(PQueueTest, Heap) {
+			auto& rd = mt();
+			CheckHeapOrder<pqueue_heap<MyPair, std::less<MyPair>, InsertAfter, 2>, InsertAfter>(rd);
+			CheckHeapOrder<pqueue_heap<MyPair, std::less<MyPair>, InsertBefore, 2>, InsertBefore>(rd);
+			CheckHeapOrder<pqueue_heap<MyPair, std::less<MyPair>, InsertAfter, 4>, InsertAfter>(rd);
+			CheckHeapOrder<pqueue_heap<MyPair, std::less<MyPair>, InsertBefore, 4>, InsertBefore>(rd);
+		}
+		namespace {
+			// push_rangeで追加した結果が1つずつpushした場合と一致するか
+			template <class Insert>
+			void CheckPushRange(lubee::RandomMT& mt) {
+				const auto rdi = mt.getUniformF<int>();
+				using Q = pqueue<MyPair, std::deque, std::less<MyPair>, Insert>;
+				Q ref, q;
+				int serial = 0;
+				int nOp = rdi({1, 32});
+				while(nOp-- != 0) {
+					std::vector<MyPair> v(rdi({0, 64}));
+					for(auto& p : v) {
+						p = MyPair{rdi({0, 16}), serial++};
+						ref.push(p);
+					}
+					q.push_range(v.begin(), v.end());
+					ASSERT_EQ(ref.size(), q.size());
+					auto itr = q.cbegin();
+					for(auto itr2=ref.cbegin() ; itr2!=ref.cend() ; ++itr, ++itr2) {
+						ASSERT_EQ(itr2->a, itr->a);
+						ASSERT_EQ(itr2->b, itr->b);
+					}
+					// 先頭を幾つか取り除く
+					for(int i=rdi({0, int(ref.size())}) ; i>0 ; i--) {
+						ref.pop_front();
+						q.pop_front();
+					}
+				}
+			}
+		}
+		TEST_F(PQueueTest, PushRange) {
+			auto& rd = mt();
+			CheckPushRange<InsertAfter>(rd);
+			CheckPushRange<InsertBefore>(rd);
+		}
+		TEST_F(PQueueTest, HeapMoveOnly) {
+			using Data = MoveOnly<int>;
+			auto& rd = mt();
+			pqueue_heap<Data> q;
+			for(int i=0 ; i<512 ; i++)
+				q.push(Data(rd.getUniformMin(0)));
+			int check = 0;
+			while(!q.empty()) {
+				EXPECT_LE(check, q.front().getValue());
+				check = q.front().getValue();
+				q.pop_front();
+			}
+		}
+		TEST_F(PQueueTest, Indexed) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+			using Q = pqueue_indexed<MyPair, std::less<MyPair>, InsertAfter>;
+			Q q;
+			// 確認用: (優先度, 追加順)で並べたもの
+			using Key = std::pair<int, int>;
+			std::map<Key, Q::handle_t> ref;
+			std::vector<Q::handle_t> dead;
+			int serial = 0;
+			int nOp = rdi({64, 1024});
+			while(nOp-- != 0) {
+				switch(rdi({0, 4})) {
+					case 0:
+					case 1: {
+						const MyPair p{rdi({0, 16}), serial++};
+						ref.emplace(Key(p.a, p.b), q.push(p));
+						break; }
+					case 2:
+						// 任意の要素を削除
+						if(!ref.empty()) {
+							auto itr = ref.begin();
+							std::advance(itr, rdi({0, int(ref.size())-1}));
+							ASSERT_TRUE(q.has(itr->second));
+							q.erase(itr->second);
+							ASSERT_FALSE(q.has(itr->second));
+							dead.push_back(itr->second);
+							ref.erase(itr);
+						}
+						break;
+					case 3:
+						// 任意の要素の優先度を変更(再度pushしたのと同じ扱い)
+						if(!ref.empty()) {
+							auto itr = ref.begin();
+							std::advance(itr, rdi({0, int(ref.size())-1}));
+							const auto h = itr->second;
+							ASSERT_EQ(itr->first.first, q.get(h).a);
+							const MyPair p{rdi({0, 16}), serial++};
+							q.update(h, p);
+							ref.erase(itr);
+							ref.emplace(Key(p.a, p.b), h);
+						}
+						break;
+					case 4:
+						if(!ref.empty()) {
+							const auto itr = ref.begin();
+							ASSERT_EQ(itr->first.first, q.front().a);
+							ASSERT_EQ(itr->first.second, q.front().b);
+							ASSERT_EQ(itr->second, q.frontHandle());
+							q.pop_front();
+							dead.push_back(itr->second);
+							ref.erase(itr);
+						}
+						break;
+				}
+				ASSERT_EQ(ref.size(), q.size());
+			}
+			// 削除済みのハンドルは無効
+			for(auto& h : dead)
+				ASSERT_FALSE(q.has(h));
+			for(auto& r : ref) {
+				ASSERT_TRUE(q.has(r.second));
+				ASSERT_EQ(r.first.first, q.get(r.second).a);
+				ASSERT_EQ(r.first.second, q.get(r.second).b);
+			}
+			q.clear();
+			for(auto& r : ref)
+				ASSERT_FALSE(q.has(r.second));
+		}
+		TEST_F(PQueueTest, Concurrent) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+			const int nThread = rdi({1, 4}),
+					nPerThread = rdi({1, 2048});
+			pqueue_concurrent<int> q(nThread);
+			// 各スレッドが重複しない値を追加しつつ取り出す
+			std::vector<std::vector<int>> popped(nThread);
+			std::vector<std::thread> th;
+			for(int t=0 ; t<nThread ; t++) {
+				th.emplace_back([&q, &popped, t, nPerThread](){
+					auto& dst = popped[t];
+					for(int i=0 ; i<nPerThread ; i++) {
+						q.push(t*nPerThread + i);
+						if(i % 2 == 0) {
+							int v;
+							if(q.pop_front(v))
+								dst.push_back(v);
+						}
+					}
+				});
+			}
+			for(auto& t : th)
+				t.join();
+			// 残りを全て取り出す
+			std::vector<int> all;
+			int v;
+			while(q.pop_front(v))
+				all.push_back(v);
+			ASSERT_TRUE(q.empty());
+			for(auto& p : popped)
+				all.insert(all.end(), p.begin(), p.end());
+			// 追加した値が過不足なく取り出せている
+			std::sort(all.begin(), all.end());
+			ASSERT_EQ(std::size_t(nThread*nPerThread), all.size());
+			for(int i=0 ; i<nThread*nPerThread ; i++)
+				ASSERT_EQ(i, all[i]);
+		}
+		TEST_F(PQueueTest, ConcurrentPred) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+			// 状態を持つ比較関数
+			struct Cmp {
+				bool	reverse = false;
+				bool operator()(const int a, const int b) const noexcept {
+					return reverse ? b < a : a < b;
+				}
+			};
+			// ヒープが2つだけなら、1スレッドでは常に両方の先頭を比べるので厳密な順序で取り出される
+			pqueue_concurrent<int, Cmp> q(1, 1, Cmp{true});
+			ASSERT_EQ(2, q.numQueue());
+			const int n = rdi({1, 1024});
+			std::vector<int> v(n);
+			for(int i=0 ; i<n ; i++)
+				v[i] = i;
+			std::shuffle(v.begin(), v.end(), std::mt19937(rdi({0, 1<<30})));
+			for(auto i : v)
+				q.push(i);
+			for(int i=n ; i-- > 0 ; ) {
+				int val;
+				ASSERT_TRUE(q.pop_front(val));
+				ASSERT_EQ(i, val);
+			}
+			ASSERT_TRUE(q.empty());
+		}
+		TEST_F(PQueueTest, ConcurrentRelaxed) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+			// シングルスレッドでは、取り出した値の(残りの中での)順位は平均してヒープ数程度に収まる
+			pqueue_concurrent<int> q(1, 4);
+			const int n = 4096;
+			std::vector<int> v(n);
+			for(int i=0 ; i<n ; i++)
+				v[i] = i;
+			std::shuffle(v.begin(), v.end(), std::mt19937(rdi({0, 1<<30})));
+			for(auto i : v)
+				q.push(i);
+			std::vector<bool> rest(n, true);
+			std::size_t sumRank = 0;
+			for(int i=0 ; i<n ; i++) {
+				int val;
+				ASSERT_TRUE(q.pop_front(val));
+				ASSERT_TRUE(rest[val]);
+				sumRank += std::count(rest.begin(), rest.begin()+val, true);
+				rest[val] = false;
+			}
+			int val;
+			ASSERT_FALSE(q.pop_front(val));
+			ASSERT_LT(sumRank / n, q.numQueue() * 4);
+		}
+		TEST_F(PQueueTest, Radix) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+			static_assert(std::is_same_v<pqueue_monotone<uint32_t, true>, pqueue_radix<uint32_t>>);
+			static_assert(std::is_same_v<pqueue_monotone<int, true>, pqueue_heap<int>>);
+			static_assert(std::is_same_v<pqueue_monotone<uint32_t, false>, pqueue_heap<uint32_t>>);
+			// 取り出した値以上のキーだけを追加し、通常のヒープとキーの取り出し順を比べる
+			using Data = MoveOnly<uint64_t>;
+			struct GetKey {
+				uint64_t operator()(const Data& d) const noexcept {
+					return d.getValue();
+				}
+			};
+			pqueue_radix<Data, GetKey> q;
+			pqueue_heap<uint64_t> ref;
+			uint64_t last = 0;
+			int nOp = rdi({64, 4096});
+			while(nOp-- != 0) {
+				if(ref.empty() || rdi({0, 2}) != 0) {
+					// 時々桁の大きく異なるキーを混ぜる
+					const uint64_t key = last + (rdi({0, 15}) == 0 ? uint64_t(rdi({0, 1<<30})) << 20 : rdi({0, 64}));
+					q.push(Data(key));
+					ref.push(key);
+				} else {
+					ASSERT_EQ(ref.front(), q.front().getValue());
+					last = ref.front();
+					Data d(0);
+					q.pop_front(d);
+					ASSERT_EQ(last, d.getValue());
+					ASSERT_EQ(last, q.lastKey());
+					ref.pop_front();
+				}
+				ASSERT_EQ(ref.size(), q.size());
+			}
+			while(!ref.empty()) {
+				ASSERT_EQ(ref.front(), q.front().getValue());
+				ref.pop_front();
+				q.pop_front();
+			}
+			ASSERT_TRUE(q.empty());
+		}
 	}
 }
@@ -1,5 +1,6 @@
 #include "test.hpp"
 #include "../profiler.hpp"
+#include "../flyweight.hpp"
 #include <boost/format.hpp>
 
 namespace spi {
@@ -84,5 +85,38 @@ namespace spi {
 				}
 			}
 		}
+		namespace {
+			const prof::Name c_value0 = "value_0",
+							c_value1 = "value_1";
+			struct ValueSource {
+				template <class F>
+				void iterate(F&& f) const {
+					f(c_value0, 1.0);
+					f(c_value1, 2.0);
+				}
+			};
+		}
+		TEST_F(ProfilerTest, Value) {
+			profiler.setValue(c_value0, 0.0);
+			profiler.setValues(ValueSource());
+			const auto& ci = profiler.getCurrent();
+			ASSERT_EQ(2, ci.value.size());
+			// 同じ名前は最後に記録した値になる
+			ASSERT_EQ(1.0, ci.value.at(c_value0));
+			ASSERT_EQ(2.0, ci.value.at(c_value1));
+		}
+		// 名前の異なる統計情報は別々に記録される
+		TEST_F(ProfilerTest, FlyweightStats) {
+			const flyweight::StatsKey key0("Fw0"),
+										key1("Fw1");
+			flyweight::Stats st0, st1;
+			st0.nValue = 1;
+			st1.nValue = 2;
+			profiler.setValues(st0.named(key0));
+			profiler.setValues(st1.named(key1));
+			const auto& ci = profiler.getCurrent();
+			ASSERT_EQ(1.0, ci.value.at(key0[flyweight::StatsKey::Value]));
+			ASSERT_EQ(2.0, ci.value.at(key1[flyweight::StatsKey::Value]));
+		}
 	}
 }
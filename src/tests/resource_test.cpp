@@ -1,10 +1,12 @@
 #include "test.hpp"
 #include "../resmgr.hpp"
 #include "../resmgr_named.hpp"
+#include "../resmgr_named_concurrent.hpp"
 #include "lubee/src/random/string.hpp"
 #include "../serialization/resmgr.hpp"
 #include "../serialization/resmgr_named.hpp"
 #include "../enum.hpp"
+#include <thread>
 
 namespace spi {
 	namespace test {
@@ -94,10 +96,18 @@ namespace spi {
 				private:
 					using base_t = ResMgrName<T>;
 				public:
+					using key_t = typename base_t::key_t;
+					using view_t = typename base_t::view_t;
 					// キー名は全て大文字にする
-					void _modifyResourceName(typename base_t::key_t& key) const override {
-						for(auto& c : key)
+					static key_t ToUpper(const view_t key) {
+						key_t ret(key);
+						for(auto& c : ret)
 							c = std::toupper(c);
+						return ret;
+					}
+					bool _modifyResourceName(const view_t key, key_t& dst) const override {
+						dst = ToUpper(key);
+						return true;
 					}
 			};
 			using rawvalue_t = T;
@@ -126,6 +136,46 @@ namespace spi {
 			}
 			lubee::CheckSerialization(mgr);
 		}
+		TYPED_TEST(ResourceMgrName, StringView) {
+			USING(value_t);
+			USING(rawvalue_t);
+			const auto mtf = this->mt().template getUniformF<int>();
+			const auto rv = this->mt().template getUniformF<value_t>();
+			const auto key = lubee::random::GenAlphabetString(mtf, 16);
+			std::string tk(key);
+			// キーを改変しないマネージャ
+			{
+				ResMgrName<rawvalue_t> mgr;
+				const auto r = mgr.emplace(key, rv());
+				ASSERT_TRUE(r.second);
+				const std::string_view sv(key);
+				ASSERT_EQ(r.first, mgr.get(sv));
+				ASSERT_EQ(r.first, mgr.get(key.c_str()));
+				// 同じキーで確保すると既存のリソースが返る
+				ASSERT_FALSE(mgr.emplace(sv, rv()).second);
+				tk.push_back('_');
+				ASSERT_FALSE(mgr.get(std::string_view(tk)));
+			}
+			// キーを大文字に改変するマネージャ
+			{
+				auto& mgr = this->getMgr();
+				const auto r = mgr.emplace(std::string_view(key), rv());
+				ASSERT_TRUE(r.second);
+				const std::string uk = mgr.ToUpper(key);
+				ASSERT_EQ(r.first, mgr.get(std::string_view(key)));
+				ASSERT_EQ(r.first, mgr.get(std::string_view(uk)));
+				ASSERT_EQ(uk, *mgr.getKey(r.first));
+				// 置き換えと無名化もビューを受け取り、キーを改変してから検索する
+				std::string oldKey;
+				const auto r2 = mgr.replaceEmplace(std::string_view(key), &oldKey, rv());
+				ASSERT_TRUE(r2.second);
+				ASSERT_EQ(r.first, mgr.get(std::string_view(oldKey)));
+				ASSERT_EQ(r2.first, mgr.get(std::string_view(key)));
+				ASSERT_TRUE(mgr.setAnonymous(std::string_view(key)));
+				ASSERT_FALSE(mgr.get(std::string_view(uk)));
+				ASSERT_TRUE(IsAnonymous(*mgr.getKey(r2.first)));
+			}
+		}
 		DefineEnum(
 			ActionN,
 			(Acquire)
@@ -168,8 +218,7 @@ namespace spi {
 						// 新たにリソースを確保
 						const auto val = rv();
 						const auto key = lubee::random::GenAlphabetString(mtf, 16);
-						auto tk(key);
-						mgr._modifyResourceName(tk);
+						const auto tk = mgr.ToUpper(key);
 						std::pair<res_t,bool> r;
 						if(mtf({0,1})) {
 							if(mtf({0,1}))
@@ -311,5 +360,290 @@ namespace spi {
 			// 全てリソースを開放したのでマネージャのリソース数もゼロになる
 			ASSERT_EQ(0, mgr.size());
 		}
+		TYPED_TEST(ResourceMgrName, Concurrent) {
+			USING(value_t);
+			USING(rawvalue_t);
+			InitializeCounter<TypeParam>();
+			using mgr_t = ResMgrNameConcurrent<rawvalue_t, std::string, 4>;
+			const auto mtf = this->mt().template getUniformF<int>();
+			const auto rv = this->mt().template getUniformF<value_t>();
+			{
+				mgr_t mgr;
+				const auto key = lubee::random::GenAlphabetString(mtf, 16) + "0";
+				const auto val = rv();
+				const auto r0 = mgr.emplace(key, val);
+				ASSERT_TRUE(r0.second);
+				ASSERT_EQ(val, r0.first->getValue());
+				ASSERT_FALSE(mgr.emplace(std::string_view(key), rv()).second);
+				ASSERT_EQ(r0.first, mgr.get(key));
+				ASSERT_EQ(key, *mgr.getKey(r0.first));
+				ASSERT_EQ(1, mgr.size());
+
+				// 無名リソース
+				const auto a = mgr.emplaceA(rv());
+				const auto akey = *mgr.getKey(a);
+				ASSERT_TRUE(IsAnonymous(akey));
+				ASSERT_EQ(a, mgr.get(akey));
+
+				// 置き換えると古いリソースは無名になる
+				std::string oldKey;
+				const auto r1 = mgr.replaceEmplace(key, &oldKey, rv());
+				ASSERT_TRUE(r1.second);
+				ASSERT_EQ(r1.first, mgr.get(key));
+				ASSERT_EQ(r0.first, mgr.get(oldKey));
+				ASSERT_EQ(oldKey, *mgr.getKey(r0.first));
+				ASSERT_EQ(3, mgr.size());
+
+				// 管轄外のリソース
+				ResMgrNameConcurrent<rawvalue_t> mgr2;
+				ASSERT_FALSE(mgr2.getKey(r0.first));
+
+				// clear()した後は検索に掛からない
+				mgr.clear();
+				ASSERT_FALSE(mgr.get(key));
+				ASSERT_EQ(0, mgr.size());
+			}
+			ASSERT_NO_FATAL_FAILURE(CheckCounter<TypeParam>(0));
+			// 同じアドレスにマネージャを作り直しても、以前のスナップショットは使われない
+			for(int i=0 ; i<2 ; i++) {
+				mgr_t mgr;
+				ASSERT_FALSE(mgr.get("snap"));
+				const auto r = mgr.emplace("snap", rv());
+				ASSERT_EQ(r.first, mgr.get("snap"));
+			}
+			ASSERT_NO_FATAL_FAILURE(CheckCounter<TypeParam>(0));
+
+			// 複数スレッドから確保、検索、解放をしても
+			// 同じキーに対しては常に同じリソースが返る
+			// (TestObjの生成カウンタはスレッドセーフではないので値を直接持つ)
+			using vmgr_t = ResMgrNameConcurrent<value_t, std::string, 4>;
+			vmgr_t mgr;
+			constexpr int NThread = 4,
+						NKey = 16,
+						NIter = 2000;
+			std::vector<std::string> key(NKey);
+			for(int i=0 ; i<NKey ; i++)
+				key[i] = "key_" + std::to_string(i);
+			std::atomic<bool> fail{false};
+			std::vector<std::thread> th;
+			for(int t=0 ; t<NThread ; t++) {
+				th.emplace_back([&, t](){
+					std::vector<typename vmgr_t::shared_t> hold(NKey);
+					uint32_t rnd = t*7919 + 1;
+					for(int i=0 ; i<NIter ; i++) {
+						rnd = rnd*1103515245 + 12345;
+						const int idx = (rnd >> 16) % NKey;
+						switch((rnd >> 8) % 3) {
+							case 0:
+							{
+								const auto r = mgr.emplace(key[idx], value_t(idx));
+								if(*r.first != value_t(idx) ||
+									(hold[idx] && hold[idx] != r.first))
+									fail = true;
+								hold[idx] = r.first;
+								break;
+							}
+							case 1:
+							{
+								const auto r = mgr.get(key[idx]);
+								if(r && *r != value_t(idx))
+									fail = true;
+								if(hold[idx] && r != hold[idx])
+									fail = true;
+								break;
+							}
+							case 2:
+								// 別のスレッドで最後の参照が外れることもある
+								hold[idx].reset();
+								break;
+						}
+					}
+				});
+			}
+			for(auto& t : th)
+				t.join();
+			ASSERT_FALSE(fail);
+			ASSERT_EQ(0, mgr.size());
+		}
+		// 1つのシャードに多数のキーを入れてスナップショットのトライを分割させても、全て検索できる
+		TYPED_TEST(ResourceMgrName, ConcurrentManyKeys) {
+			USING(value_t);
+			using mgr_t = ResMgrNameConcurrent<value_t, std::string, 1>;
+			mgr_t mgr;
+			const int n = this->mt().template getUniform<int>({256, 4096});
+			std::vector<typename mgr_t::shared_t> hold;
+			for(int i=0 ; i<n ; i++)
+				hold.push_back(mgr.emplace(std::to_string(i), value_t(i)).first);
+			ASSERT_EQ(std::size_t(n), mgr.size());
+			for(int i=0 ; i<n ; i++)
+				ASSERT_EQ(hold[i], mgr.get(std::to_string(i)));
+			ASSERT_FALSE(mgr.get(std::to_string(n)));
+			// 奇数番目を解放する
+			for(int i=1 ; i<n ; i+=2)
+				hold[i].reset();
+			for(int i=0 ; i<n ; i++) {
+				if(i & 1)
+					ASSERT_FALSE(mgr.get(std::to_string(i)));
+				else
+					ASSERT_EQ(hold[i], mgr.get(std::to_string(i)));
+			}
+			hold.clear();
+			ASSERT_EQ(0, mgr.size());
+			ASSERT_FALSE(mgr.get("0"));
+		}
+		TYPED_TEST(ResourceMgrName, Async) {
+			USING(value_t);
+			using mgr_t = ResMgrNameConcurrent<value_t, std::string, 4>;
+			mgr_t mgr;
+			mgr.setWorkerPool(std::make_shared<WorkerPool>(2));
+			const auto rv = this->mt().template getUniformF<value_t>();
+			const value_t val = rv();
+
+			// 作成中の同じキーへの要求は1つにまとめられる
+			std::promise<void> gate;
+			const std::shared_future<void> gf = gate.get_future().share();
+			// 途中でテストが失敗しても、ワーカーを待たせたまま終了しない
+			struct GateGuard {
+				std::promise<void>&	gate;
+				bool				opened = false;
+
+				void open() {
+					if(!opened) {
+						opened = true;
+						gate.set_value();
+					}
+				}
+				~GateGuard() {
+					open();
+				}
+			} gateGuard{gate};
+			std::atomic<int> nMake{0};
+			const auto make = [gf, &nMake, val](auto& /*key*/, auto&& mk){
+				gf.wait();
+				++nMake;
+				mk(val);
+			};
+			auto f0 = mgr.acquireAsync("async", make),
+				f1 = mgr.acquireAsync(std::string("async"), make);
+			ASSERT_FALSE(mgr.get("async"));
+			gateGuard.open();
+			const auto r0 = f0.get();
+			ASSERT_EQ(r0, f1.get());
+			ASSERT_EQ(1, nMake.load());
+			ASSERT_EQ(val, *r0);
+			ASSERT_EQ(r0, mgr.get("async"));
+			ASSERT_EQ("async", *mgr.getKey(r0));
+
+			// 確保済みのリソースは完了済みのfutureで返る
+			auto f2 = mgr.acquireAsync("async", make);
+			ASSERT_EQ(std::future_status::ready, f2.wait_for(std::chrono::seconds(0)));
+			ASSERT_EQ(r0, f2.get());
+			ASSERT_EQ(1, nMake.load());
+
+			// 作成時の例外はfutureから受け取る
+			auto f3 = mgr.acquireAsync("error", [](auto& /*key*/, auto&& /*mk*/){
+				throw std::runtime_error("make failed");
+			});
+			ASSERT_THROW(f3.get(), std::runtime_error);
+			ASSERT_FALSE(mgr.get("error"));
+			// 失敗した後は作り直せる
+			auto f4 = mgr.acquireAsync("error", make);
+			ASSERT_EQ(val, *f4.get());
+			ASSERT_EQ(2, mgr.size());
+		}
+		TYPED_TEST(ResourceMgrName, AsyncAndSync) {
+			USING(value_t);
+			using mgr_t = ResMgrNameConcurrent<value_t, std::string, 4>;
+			mgr_t mgr;
+			mgr.setWorkerPool(std::make_shared<WorkerPool>(2));
+			const auto rv = this->mt().template getUniformF<value_t>();
+			const value_t val0 = rv(),
+						val1 = rv();
+
+			std::promise<void> gate;
+			const std::shared_future<void> gf = gate.get_future().share();
+			std::atomic<int> nMake{0};
+			std::atomic<bool> fail{false};
+			const auto make = [gf, &nMake, &fail, val0](auto& /*key*/, auto&& mk){
+				gf.wait();
+				++nMake;
+				if(fail)
+					throw std::runtime_error("make failed");
+				mk(val0);
+			};
+			// 作成中のキーを同期的に確保すると、非同期の作成を待って同じリソースを返す
+			// (テストが途中で失敗しても、ゲートを開けてからスレッドを待つ)
+			std::future<typename mgr_t::shared_t> fs;
+			const auto wait = [&](){
+				try { gate.set_value(); } catch(const std::future_error&) {}
+				if(fs.valid())
+					fs.wait();
+			};
+			struct Guard {
+				const std::function<void ()> f;
+				~Guard() { f(); }
+			} guard{wait};
+			auto fa = mgr.acquireAsync("key", make);
+			fs = std::async(std::launch::async, [&mgr, val1](){
+				const auto ret = mgr.emplace("key", val1);
+				return ret.second ? nullptr : ret.first;
+			});
+			wait();
+			const auto r0 = fa.get();
+			ASSERT_EQ(r0, fs.get());
+			ASSERT_EQ(1, nMake.load());
+			ASSERT_EQ(val0, *r0);
+
+			// 非同期の作成が失敗した場合は、待っていた側が作り直す
+			gate = std::promise<void>();
+			const std::shared_future<void> gf2 = gate.get_future().share();
+			fail = true;
+			auto fe = mgr.acquireAsync("fail", [gf2, &make](auto& key, auto&& mk){
+				gf2.wait();
+				make(key, mk);
+			});
+			fs = std::async(std::launch::async, [&mgr, val1](){
+				const auto ret = mgr.emplace("fail", val1);
+				return ret.second ? ret.first : nullptr;
+			});
+			wait();
+			ASSERT_THROW(fe.get(), std::runtime_error);
+			const auto r1 = fs.get();
+			ASSERT_TRUE(r1);
+			ASSERT_EQ(val1, *r1);
+			ASSERT_EQ(r1, mgr.get("fail"));
+		}
+		TYPED_TEST(ResourceMgrName, AsyncPostFailure) {
+			USING(value_t);
+			using mgr_t = ResMgrNameConcurrent<value_t, std::string, 4>;
+			mgr_t mgr;
+			mgr.setWorkerPool(std::make_shared<WorkerPool>(1));
+			const auto rv = this->mt().template getUniformF<value_t>();
+			const value_t val = rv();
+
+			// タスクに移す時(ムーブ)に例外を投げるMake
+			struct Make {
+				bool	throwOnMove;
+				value_t	val;
+				Make(const bool t, const value_t v): throwOnMove(t), val(v) {}
+				Make(const Make&) = default;
+				Make(Make&& m): throwOnMove(m.throwOnMove), val(m.val) {
+					if(throwOnMove)
+						throw std::runtime_error("move failed");
+				}
+				void operator()(const std::string& /*key*/, typename mgr_t::template Constructor<value_t>& mk) const {
+					mk(val);
+				}
+			};
+			const Make bad(true, val);
+			ASSERT_THROW(mgr.acquireAsync("key", bad), std::runtime_error);
+			// 作成中の登録が残っていなければ、次の要求で新しく作成される
+			// (残っていると、完了しないfutureが返ってしまう)
+			const auto r0 = mgr.acquireAsync("key", Make(false, val)).get();
+			ASSERT_EQ(val, *r0);
+			const auto r1 = mgr.emplace("key", val);
+			ASSERT_FALSE(r1.second);
+			ASSERT_EQ(r0, r1.first);
+		}
 	}
 }
@@ -0,0 +1,91 @@
+#include "test.hpp"
+#include "../string_table.hpp"
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+
+namespace spi {
+	namespace test {
+		struct StringTableTest : Random {};
+		TEST_F(StringTableTest, Intern) {
+			auto& mt = this->mt();
+			const auto rdi = mt.getUniformF<int>();
+			// ページを跨いだり、専用ページを使う長さも混ぜる
+			StringTable<> table(256);
+			std::unordered_map<std::string, Symbol> ref;
+			int N = rdi({64, 1024});
+			while(N-- != 0) {
+				const std::size_t len = rdi({0, 15}) == 0 ? rdi({0, 512}) : rdi({0, 8});
+				std::string str;
+				for(std::size_t i=0 ; i<len ; i++)
+					str.push_back('a' + rdi({0, 3}));
+				const auto sym = table.intern(str);
+				ASSERT_EQ(str, sym.view());
+				ASSERT_STREQ(str.c_str(), sym.c_str());
+				ASSERT_EQ(str.size(), sym.size());
+				ASSERT_EQ(std::hash<std::string>()(str), std::hash<Symbol>()(sym));
+				const auto [itr, added] = ref.emplace(str, sym);
+				// 同じ文字列なら同じハンドル
+				ASSERT_EQ(itr->second, sym);
+				ASSERT_EQ(sym, table.find(str));
+				ASSERT_EQ(ref.size(), table.size());
+			}
+			// 登録済みのハンドルは後から登録した文字列の影響を受けない
+			for(auto& r : ref) {
+				ASSERT_EQ(r.first, r.second.view());
+				for(auto& r2 : ref) {
+					if(&r == &r2)
+						break;
+					ASSERT_NE(r.second, r2.second);
+					ASSERT_EQ(r.first < r2.first, r.second < r2.second);
+				}
+			}
+			ASSERT_FALSE(table.find("not registered string"));
+			ASSERT_FALSE(Symbol());
+			ASSERT_TRUE(Symbol().empty());
+
+			// 長さが32bitに収まらない文字列は登録できない(中身を読む前に弾く)
+			if constexpr (sizeof(std::size_t) > sizeof(uint32_t)) {
+				const char c = 0;
+				const std::string_view huge(&c, std::size_t(std::numeric_limits<uint32_t>::max()) + 1);
+				ASSERT_ANY_THROW(table.intern(huge));
+			}
+		}
+		TEST_F(StringTableTest, Concurrent) {
+			StringTable<flyweight::Sharded<4>> table;
+			const int nThread = mt().getUniform<int>({2, 4});
+			std::vector<std::vector<Symbol>> sym(nThread);
+			std::vector<std::thread> th;
+			// 登録と並行して統計値を読んでも競合しない
+			std::atomic_bool end = false;
+			std::thread reader([&table, &end](){
+				std::size_t prev = 0;
+				while(!end.load(std::memory_order_acquire)) {
+					const std::size_t n = table.size();
+					ASSERT_LE(prev, n);
+					ASSERT_LE(n, 1024u);
+					// 確保量は減らないので、先に読んだ文字列量を超えない
+					const std::size_t nByte = table.stringBytes();
+					ASSERT_LE(nByte, table.reservedBytes());
+					prev = n;
+				}
+			});
+			for(int t=0 ; t<nThread ; t++) {
+				th.emplace_back([&table, &sym, t](){
+					for(int i=0 ; i<1024 ; i++)
+						sym[t].push_back(table.intern(std::to_string(i)));
+				});
+			}
+			for(auto& t : th)
+				t.join();
+			end.store(true, std::memory_order_release);
+			reader.join();
+			// 全てのスレッドで同じハンドルが得られる
+			ASSERT_EQ(1024, table.size());
+			for(int t=1 ; t<nThread ; t++)
+				ASSERT_EQ(sym[0], sym[t]);
+			for(int i=0 ; i<1024 ; i++)
+				ASSERT_EQ(std::to_string(i), sym[0][i].view());
+		}
+	}
+}
@@ -0,0 +1,134 @@
+#include "test.hpp"
+#include "moveonly.hpp"
+#include "../timer_wheel.hpp"
+#include <map>
+#include <memory>
+
+namespace spi {
+	namespace test {
+		template <class T>
+		class TimerWheelTest : public Random {};
+		// 階層の境界やホイールの範囲外を踏みやすいよう、小さいホイールも試す
+		template <std::size_t B, std::size_t L>
+		struct Size {
+			constexpr static std::size_t Bits = B,
+										Levels = L;
+		};
+		using SizeTypes = ::testing::Types<Size<2,3>, Size<3,2>, Size<6,4>>;
+		TYPED_TEST_SUITE(TimerWheelTest, SizeTypes);
+
+		TYPED_TEST(TimerWheelTest, Random) {
+			auto& mt = this->mt();
+			const auto rdi = mt.template getUniformF<int>();
+			using TW = timer_wheel<MoveOnly<int>, TypeParam::Bits, TypeParam::Levels>;
+			using tick_t = typename TW::tick_t;
+			TW tw(prof::Milliseconds(1), prof::Timepoint());
+			// 確認用: 追加順 -> (期限, ハンドル)
+			std::map<int, std::pair<tick_t, typename TW::handle_t>> ref;
+			std::vector<typename TW::handle_t> dead;
+			int serial = 0;
+			int nOp = rdi({64, 1024});
+			while(nOp-- != 0) {
+				switch(rdi({0, 3})) {
+					case 0:
+					case 1: {
+						const tick_t due = tw.nowTick() + rdi({1, 300});
+						const int id = serial++;
+						ref.emplace(id, std::make_pair(due, tw.pushTick(due, MoveOnly<int>(id))));
+						break; }
+					case 2:
+						// 任意の要素をキャンセル
+						if(!ref.empty()) {
+							auto itr = ref.begin();
+							std::advance(itr, rdi({0, int(ref.size())-1}));
+							const auto h = itr->second.second;
+							ASSERT_TRUE(tw.has(h));
+							ASSERT_TRUE(tw.cancel(h));
+							ASSERT_FALSE(tw.has(h));
+							ASSERT_FALSE(tw.cancel(h));
+							dead.push_back(h);
+							ref.erase(itr);
+						}
+						break;
+					case 3: {
+						// 時間を進めて期限が来た物を全て取り出す
+						tw.advanceTick(tw.nowTick() + rdi({0, 40}));
+						const tick_t now = tw.nowTick();
+						tick_t prev = 0;
+						while(!tw.empty()) {
+							const tick_t due = tw.frontTick();
+							ASSERT_LE(prev, due);
+							ASSERT_LE(due, now);
+							prev = due;
+							const int id = tw.front().getValue();
+							const auto itr = ref.find(id);
+							ASSERT_NE(ref.end(), itr);
+							ASSERT_EQ(itr->second.first, due);
+							dead.push_back(itr->second.second);
+							ref.erase(itr);
+							tw.pop_front();
+						}
+						// 期限が来ていない物だけが残っている
+						for(auto& r : ref) {
+							ASSERT_LT(now, r.second.first);
+							ASSERT_TRUE(tw.has(r.second.second));
+						}
+						break; }
+				}
+				ASSERT_EQ(ref.size(), tw.size());
+			}
+			for(auto& h : dead)
+				ASSERT_FALSE(tw.has(h));
+			tw.clear();
+			ASSERT_EQ(0, tw.size());
+			ASSERT_TRUE(tw.empty());
+			for(auto& r : ref)
+				ASSERT_FALSE(tw.has(r.second.second));
+		}
+		TYPED_TEST(TimerWheelTest, Timepoint) {
+			using TW = timer_wheel<int, TypeParam::Bits, TypeParam::Levels>;
+			const prof::Timepoint origin;
+			TW tw(prof::Milliseconds(1), origin);
+			// 期限はtick境界に切り上げられる
+			tw.push(origin + prof::Microseconds(2500), 1);
+			tw.push(origin + prof::Milliseconds(3), 2);
+			tw.advance(origin + prof::Microseconds(2900));
+			ASSERT_TRUE(tw.empty());
+			tw.advance(origin + prof::Milliseconds(3));
+			ASSERT_FALSE(tw.empty());
+			int v;
+			tw.pop_front(v);
+			ASSERT_EQ(1, v);
+			tw.pop_front(v);
+			ASSERT_EQ(2, v);
+			ASSERT_TRUE(tw.empty());
+			// 既に過ぎた時刻は即座に取り出せる
+			tw.push(origin, 3);
+			ASSERT_FALSE(tw.empty());
+			ASSERT_EQ(3, tw.front());
+		}
+		TYPED_TEST(TimerWheelTest, ReleaseValue) {
+			using TW = timer_wheel<std::shared_ptr<int>, TypeParam::Bits, TypeParam::Levels>;
+			TW tw;
+			const auto sp = std::make_shared<int>(0);
+			// キャンセルした時点で値は破棄される
+			const auto h = tw.pushTick(10, sp);
+			ASSERT_EQ(2, sp.use_count());
+			ASSERT_TRUE(tw.cancel(h));
+			ASSERT_EQ(1, sp.use_count());
+			// 取り出した時点で値は破棄される
+			tw.pushTick(1, sp);
+			tw.pushTick(1, sp);
+			ASSERT_EQ(3, sp.use_count());
+			tw.advanceTick(1);
+			tw.pop_front();
+			ASSERT_EQ(2, sp.use_count());
+			std::shared_ptr<int> dst;
+			tw.pop_front(dst);
+			ASSERT_EQ(2, sp.use_count());
+			dst.reset();
+			ASSERT_EQ(1, sp.use_count());
+			ASSERT_EQ(0, tw.size());
+		}
+	}
+}
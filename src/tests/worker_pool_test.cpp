@@ -0,0 +1,29 @@
+#include "test.hpp"
+#include "../worker_pool.hpp"
+#include <atomic>
+
+namespace spi {
+	namespace test {
+		struct WorkerPool : Random {};
+		TEST_F(WorkerPool, Run) {
+			auto& mt = this->mt();
+			const auto nThread = mt.getUniform<std::size_t>({1, 4});
+			const int nTask = mt.getUniform<int>({0, 256});
+			std::atomic<int> count{0},
+							sum{0};
+			{
+				::spi::WorkerPool pool(nThread);
+				ASSERT_EQ(nThread, pool.numThread());
+				for(int i=0 ; i<nTask ; i++) {
+					pool.post([&count, &sum, i](){
+						++count;
+						sum += i;
+					});
+				}
+				// 破棄時に残りのタスクを全て実行する
+			}
+			ASSERT_EQ(nTask, count.load());
+			ASSERT_EQ(nTask*(nTask-1)/2, sum.load());
+		}
+	}
+}
@@ -0,0 +1,262 @@
+#pragma once
+#include "prof_clock.hpp"
+#include "optional.hpp"
+#include "lubee/src/error.hpp"
+#include <vector>
+#include <array>
+#include <cstdint>
+
+namespace spi {
+	//! 階層タイマーホイール
+	/*!
+		時刻順に取り出すという点でpqueueの代替として使う
+		追加、キャンセルがO(1)、時間を進める処理がならしO(1)
+		時刻はtick単位に丸められ、同じtickの要素は(おおむね)追加順に取り出される
+		advance()で期限が来た要素だけが取り出し可能になる(front, pop_front)
+		\tparam Bits	1階層あたりのスロット数(2^Bits)
+		\tparam Levels	階層数(これを超える先の時刻は最上位の階層に置いて再配置する)
+	*/
+	template <class T, std::size_t Bits=6, std::size_t Levels=4>
+	class timer_wheel {
+		public:
+			using tick_t = uint64_t;
+			//! 要素を指すハンドル(取り出し、キャンセル後は無効になる)
+			struct Handle {
+				uint32_t	index = ~uint32_t(0),
+							gen = 0;
+				bool operator == (const Handle& h) const noexcept {
+					return index == h.index && gen == h.gen;
+				}
+				bool operator != (const Handle& h) const noexcept {
+					return !(this->operator == (h));
+				}
+			};
+		private:
+			static_assert(Bits > 0 && Levels > 0 && Bits*Levels < 64, "invalid wheel size");
+			constexpr static std::size_t	NSlot = std::size_t(1) << Bits;
+			constexpr static tick_t			SlotMask = NSlot - 1,
+											MaxRange = (tick_t(1) << (Bits*Levels)) - 1;
+			constexpr static uint32_t		Invalid = ~uint32_t(0);
+
+			struct List {
+				uint32_t	head = Invalid,
+							tail = Invalid;
+			};
+			struct Node {
+				//! 取り出し、キャンセル時に破棄する(スロットの再利用まで値を生存させない)
+				Optional<T>	value;
+				tick_t		due;
+				uint32_t	prev = Invalid,
+							next = Invalid,
+							gen = 0;
+				bool		used = false;
+				List*		list = nullptr;		//!< 所属しているリスト
+			};
+			using NodeV = std::vector<Node>;
+			using FreeV = std::vector<uint32_t>;
+			using Wheel = std::array<std::array<List, NSlot>, Levels>;
+
+			NodeV			_node;
+			FreeV			_free;
+			Wheel			_wheel;
+			List			_ready;			//!< 期限が来た要素
+			tick_t			_now;
+			std::size_t		_size;
+			prof::Duration	_tickLen;
+			prof::Timepoint	_origin;
+
+			void _append(List& l, const uint32_t idx) {
+				auto& n = _node[idx];
+				n.prev = l.tail;
+				n.next = Invalid;
+				n.list = &l;
+				if(l.tail != Invalid)
+					_node[l.tail].next = idx;
+				else
+					l.head = idx;
+				l.tail = idx;
+			}
+			void _unlink(const uint32_t idx) {
+				auto& n = _node[idx];
+				if(n.prev != Invalid)
+					_node[n.prev].next = n.next;
+				else
+					n.list->head = n.next;
+				if(n.next != Invalid)
+					_node[n.next].prev = n.prev;
+				else
+					n.list->tail = n.prev;
+			}
+			//! 現在時刻からの差に応じて適切な階層のスロットへ
+			void _place(const uint32_t idx) {
+				const tick_t due = _node[idx].due;
+				if(due <= _now) {
+					_append(_ready, idx);
+					return;
+				}
+				tick_t key = due;
+				const tick_t diff = due - _now;
+				if(diff > MaxRange)
+					key = _now + MaxRange;
+				std::size_t level = 0;
+				while(level+1 < Levels && (key - _now) >= (tick_t(1) << (Bits*(level+1))))
+					++level;
+				_append(_wheel[level][(key >> (Bits*level)) & SlotMask], idx);
+			}
+			//! 上位階層のスロットの中身を再配置
+			void _cascade(const std::size_t level) {
+				auto& l = _wheel[level][(_now >> (Bits*level)) & SlotMask];
+				uint32_t cur = l.head;
+				l.head = l.tail = Invalid;
+				while(cur != Invalid) {
+					const uint32_t next = _node[cur].next;
+					_place(cur);
+					cur = next;
+				}
+			}
+			void _releaseNode(const uint32_t idx) {
+				auto& n = _node[idx];
+				n.value = none;
+				n.used = false;
+				// 古いハンドルを無効化
+				++n.gen;
+				_free.push_back(idx);
+				--_size;
+			}
+			tick_t _toTick(const prof::Timepoint tp, const bool ceil) const {
+				if(tp <= _origin)
+					return 0;
+				const auto d = tp - _origin;
+				tick_t t = d / _tickLen;
+				if(ceil && d % _tickLen != prof::Duration::zero())
+					++t;
+				return t;
+			}
+
+		public:
+			using handle_t = Handle;
+			//! \param[in] tickLen	1tickあたりの時間
+			//! \param[in] origin	tick=0とする時刻
+			timer_wheel(
+				const prof::Duration tickLen = prof::Milliseconds(1),
+				const prof::Timepoint origin = prof::Clock::now()
+			):
+				_now(0),
+				_size(0),
+				_tickLen(tickLen),
+				_origin(origin)
+			{
+				D_Assert0(tickLen > prof::Duration::zero());
+			}
+			timer_wheel(const timer_wheel&) = delete;
+			timer_wheel& operator = (const timer_wheel&) = delete;
+
+			//! 指定したtickに取り出せるよう要素を追加
+			template <class TA>
+			handle_t pushTick(const tick_t due, TA&& t) {
+				uint32_t idx;
+				if(_free.empty()) {
+					idx = _node.size();
+					_node.push_back(Node{T(std::forward<TA>(t)), due});
+				} else {
+					idx = _free.back();
+					_free.pop_back();
+					auto& n = _node[idx];
+					n.value = std::forward<TA>(t);
+					n.due = due;
+				}
+				auto& n = _node[idx];
+				n.used = true;
+				++_size;
+				_place(idx);
+				return Handle{idx, n.gen};
+			}
+			//! 指定した時刻に取り出せるよう要素を追加(tick境界に切り上げ)
+			template <class TA>
+			handle_t push(const prof::Timepoint due, TA&& t) {
+				return pushTick(_toTick(due, true), std::forward<TA>(t));
+			}
+			//! ハンドルが有効な要素を指しているか
+			bool has(const handle_t& h) const noexcept {
+				return h.index < _node.size() &&
+						_node[h.index].used &&
+						_node[h.index].gen == h.gen;
+			}
+			//! 要素をキャンセル
+			/*! \return 有効なハンドルだった場合はtrue */
+			bool cancel(const handle_t& h) {
+				if(!has(h))
+					return false;
+				_unlink(h.index);
+				_releaseNode(h.index);
+				return true;
+			}
+			//! 指定したtickまで時間を進め、期限が来た要素を取り出し可能にする
+			void advanceTick(const tick_t to) {
+				while(_now < to) {
+					++_now;
+					// 下位階層が一周したら上位階層から再配置
+					for(std::size_t level=1 ; level<Levels ; level++) {
+						if((_now & ((tick_t(1) << (Bits*level)) - 1)) != 0)
+							break;
+						_cascade(level);
+					}
+					auto& l = _wheel[0][_now & SlotMask];
+					uint32_t cur = l.head;
+					l.head = l.tail = Invalid;
+					while(cur != Invalid) {
+						const uint32_t next = _node[cur].next;
+						_append(_ready, cur);
+						cur = next;
+					}
+				}
+			}
+			//! 指定した時刻まで時間を進める
+			void advance(const prof::Timepoint now) {
+				advanceTick(_toTick(now, false));
+			}
+			//! 期限が来た要素が無いか
+			bool empty() const noexcept {
+				return _ready.head == Invalid;
+			}
+			// 期限が変わってしまうかもしれないので参照はconstのみとする
+			const T& front() const {
+				D_Assert0(!empty());
+				return *_node[_ready.head].value;
+			}
+			tick_t frontTick() const {
+				D_Assert0(!empty());
+				return _node[_ready.head].due;
+			}
+			void pop_front() {
+				D_Assert0(!empty());
+				const uint32_t idx = _ready.head;
+				_unlink(idx);
+				_releaseNode(idx);
+			}
+			void pop_front(T& dst) {
+				D_Assert0(!empty());
+				dst = std::move(*_node[_ready.head].value);
+				pop_front();
+			}
+			//! 期限前の物も含めた全要素数
+			std::size_t size() const noexcept {
+				return _size;
+			}
+			tick_t nowTick() const noexcept {
+				return _now;
+			}
+			prof::Duration tickLength() const noexcept {
+				return _tickLen;
+			}
+			void clear() {
+				for(std::size_t i=0 ; i<_node.size() ; i++) {
+					if(_node[i].used)
+						_releaseNode(i);
+				}
+				for(auto& w : _wheel)
+					w.fill(List{});
+				_ready = List{};
+			}
+	};
+}
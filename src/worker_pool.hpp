@@ -0,0 +1,86 @@
+#pragma once
+#include "lubee/src/error.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+namespace spi {
+	//! 固定数のスレッドで投入された順にタスクを実行する
+	/*! 破棄時は残っているタスクを全て実行してから終了する */
+	class WorkerPool {
+		public:
+			using Task = std::function<void ()>;
+		private:
+			using TaskQ = std::deque<Task>;
+			using ThreadV = std::vector<std::thread>;
+
+			std::mutex				_mutex;
+			std::condition_variable	_cond;
+			TaskQ					_task;
+			bool					_bEnd = false;
+			ThreadV					_thread;
+
+			void _run() {
+				for(;;) {
+					Task t;
+					{
+						std::unique_lock lk(_mutex);
+						_cond.wait(lk, [this](){ return _bEnd || !_task.empty(); });
+						if(_task.empty())
+							return;
+						t = std::move(_task.front());
+						_task.pop_front();
+					}
+					t();
+				}
+			}
+
+			void _terminate() {
+				{
+					std::lock_guard lk(_mutex);
+					_bEnd = true;
+				}
+				_cond.notify_all();
+				for(auto& t : _thread)
+					t.join();
+			}
+
+		public:
+			//! \param[in] nThread	スレッド数(0ならハードウェアのスレッド数)
+			WorkerPool(std::size_t nThread = 0) {
+				if(nThread == 0)
+					nThread = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+				_thread.reserve(nThread);
+				try {
+					for(std::size_t i=0 ; i<nThread ; i++)
+						_thread.emplace_back([this](){ _run(); });
+				} catch(...) {
+					// 起動済みのスレッドを終了させてから例外を伝える
+					_terminate();
+					throw;
+				}
+			}
+			WorkerPool(const WorkerPool&) = delete;
+			WorkerPool& operator = (const WorkerPool&) = delete;
+			~WorkerPool() {
+				_terminate();
+			}
+			//! タスクを追加(例外はタスク内で処理すること)
+			void post(Task t) {
+				D_Assert0(t);
+				{
+					std::lock_guard lk(_mutex);
+					D_Assert(!_bEnd, "posting a task to the terminating pool");
+					_task.push_back(std::move(t));
+				}
+				_cond.notify_one();
+			}
+			std::size_t numThread() const noexcept {
+				return _thread.size();
+			}
+	};
+}